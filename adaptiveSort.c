@@ -0,0 +1,562 @@
+/*
+adaptiveSort.c
+
+Natural run detection, galloping merges and the run stack of the adaptive sort, see adaptiveSort.h.
+*/
+
+// header files
+#include <stdlib.h>
+#include <string.h>
+#include "adaptiveSort.h"
+
+// DEFINITIONS
+#define MIN_MERGE 32 // arrays shorter than this are sorted with binary insertion sort only
+#define MIN_GALLOP 7 // initial number of consecutive wins before a merge starts galloping
+
+/*
+Allocates the merge buffer for arrays of up to maxLength elements. A merge copies only the shorter
+of its two runs, so half the array is enough. Returns 0 on success, -1 if memory ran out.
+*/
+int initAdaptiveSorter(struct adaptiveSorter *sorter, int maxLength)
+{
+    memset(sorter, 0, sizeof(*sorter));
+    sorter->buffer = malloc((maxLength / 2 + 1) * sizeof(int));
+    if (sorter->buffer == NULL)
+    {
+        return -1;
+    }
+    sorter->maxLength = maxLength;
+    sorter->minGallop = MIN_GALLOP;
+    return 0;
+}
+
+void freeAdaptiveSorter(struct adaptiveSorter *sorter)
+{
+    free(sorter->buffer);
+    memset(sorter, 0, sizeof(*sorter));
+}
+
+/*
+Minimum run length for n elements: n itself if it is small, otherwise a number between MIN_MERGE / 2 and
+MIN_MERGE such that n / minrun is a power of two or just below one, which keeps the merges balanced
+*/
+static int minRunLength(int n)
+{
+    int extra = 0;
+
+    while (n >= MIN_MERGE)
+    {
+        extra |= n & 1;
+        n >>= 1;
+    }
+    return n + extra;
+}
+
+static void reverseRange(int x[], int low, int high)
+{
+    high--;
+    while (low < high)
+    {
+        int temp = x[low];
+        x[low++] = x[high];
+        x[high--] = temp;
+    }
+}
+
+/*
+Length of the run starting at low (high is exclusive). A strictly descending run is reversed in place,
+strictly so that equal elements never swap and the sort stays stable.
+*/
+static int countRun(int x[], int low, int high)
+{
+    int end = low + 1;
+
+    if (end == high)
+    {
+        return 1;
+    }
+
+    if (x[end++] < x[low])
+    {
+        while (end < high && x[end] < x[end - 1])
+        {
+            end++;
+        }
+        reverseRange(x, low, end);
+    }
+    else
+    {
+        while (end < high && x[end] >= x[end - 1])
+        {
+            end++;
+        }
+    }
+    return end - low;
+}
+
+/*
+Sorts x[low..high) where x[low..start) is already sorted, finding each insertion point by binary search
+*/
+static void binaryInsertionSort(int x[], int low, int high, int start)
+{
+    for (; start < high; start++)
+    {
+        int pivot = x[start];
+        int left = low;
+        int right = start;
+
+        while (left < right)
+        {
+            int mid = left + (right - left) / 2;
+            if (pivot < x[mid])
+                right = mid;
+            else
+                left = mid + 1;
+        }
+        memmove(&x[left + 1], &x[left], (start - left) * sizeof(int));
+        x[left] = pivot;
+    }
+}
+
+/*
+Position of key in the sorted array a[0..length), before any equal elements (a[k - 1] < key <= a[k]).
+Starts at hint and gallops outwards in steps of 1, 3, 7, 15... before the final binary search,
+so the cost is logarithmic in the distance from the hint rather than in the length.
+*/
+static int gallopLeft(int key, const int a[], int length, int hint)
+{
+    long lastOffset = 0;
+    long offset = 1;
+
+    if (key > a[hint])
+    {
+        // gallop right until a[hint + lastOffset] < key <= a[hint + offset]
+        long maxOffset = length - hint;
+        while (offset < maxOffset && key > a[hint + offset])
+        {
+            lastOffset = offset;
+            offset = (offset << 1) + 1;
+        }
+        if (offset > maxOffset)
+            offset = maxOffset;
+        lastOffset += hint;
+        offset += hint;
+    }
+    else
+    {
+        // gallop left until a[hint - offset] < key <= a[hint - lastOffset]
+        long maxOffset = hint + 1;
+        while (offset < maxOffset && key <= a[hint - offset])
+        {
+            lastOffset = offset;
+            offset = (offset << 1) + 1;
+        }
+        if (offset > maxOffset)
+            offset = maxOffset;
+        long temp = lastOffset;
+        lastOffset = hint - offset;
+        offset = hint - temp;
+    }
+
+    // a[lastOffset] < key <= a[offset], binary search in between
+    lastOffset++;
+    while (lastOffset < offset)
+    {
+        long mid = lastOffset + (offset - lastOffset) / 2;
+        if (key > a[mid])
+            lastOffset = mid + 1;
+        else
+            offset = mid;
+    }
+    return (int)offset;
+}
+
+/*
+Like gallopLeft but returns the position after any equal elements (a[k - 1] <= key < a[k])
+*/
+static int gallopRight(int key, const int a[], int length, int hint)
+{
+    long lastOffset = 0;
+    long offset = 1;
+
+    if (key < a[hint])
+    {
+        // gallop left until a[hint - offset] <= key < a[hint - lastOffset]
+        long maxOffset = hint + 1;
+        while (offset < maxOffset && key < a[hint - offset])
+        {
+            lastOffset = offset;
+            offset = (offset << 1) + 1;
+        }
+        if (offset > maxOffset)
+            offset = maxOffset;
+        long temp = lastOffset;
+        lastOffset = hint - offset;
+        offset = hint - temp;
+    }
+    else
+    {
+        // gallop right until a[hint + lastOffset] <= key < a[hint + offset]
+        long maxOffset = length - hint;
+        while (offset < maxOffset && key >= a[hint + offset])
+        {
+            lastOffset = offset;
+            offset = (offset << 1) + 1;
+        }
+        if (offset > maxOffset)
+            offset = maxOffset;
+        lastOffset += hint;
+        offset += hint;
+    }
+
+    lastOffset++;
+    while (lastOffset < offset)
+    {
+        long mid = lastOffset + (offset - lastOffset) / 2;
+        if (key < a[mid])
+            offset = mid;
+        else
+            lastOffset = mid + 1;
+    }
+    return (int)offset;
+}
+
+/*
+Merges the adjacent runs x[base1..base1+length1) and x[base2..base2+length2) with length1 <= length2,
+front to back. The first run is moved to the buffer. Both runs are known to be non-empty, the first element
+of run 2 belongs before run 1 and the last element of run 1 belongs after run 2 (mergeAt trims them).
+*/
+static void mergeLow(struct adaptiveSorter *sorter, int x[], int base1, int length1, int base2, int length2)
+{
+    int *buffer = sorter->buffer;
+    int cursor1 = 0;     // in the buffer
+    int cursor2 = base2; // in x
+    int dest = base1;
+    int minGallop = sorter->minGallop;
+
+    memcpy(buffer, &x[base1], length1 * sizeof(int));
+    x[dest++] = x[cursor2++];
+    if (--length2 == 0)
+    {
+        memcpy(&x[dest], &buffer[cursor1], length1 * sizeof(int));
+        return;
+    }
+    if (length1 == 1)
+    {
+        memmove(&x[dest], &x[cursor2], length2 * sizeof(int));
+        x[dest + length2] = buffer[cursor1];
+        return;
+    }
+
+    while (1)
+    {
+        int count1 = 0; // times in a row run 1 won
+        int count2 = 0; // times in a row run 2 won
+
+        // one element at a time until one run wins minGallop times in a row
+        do
+        {
+            if (x[cursor2] < buffer[cursor1])
+            {
+                x[dest++] = x[cursor2++];
+                count2++;
+                count1 = 0;
+                if (--length2 == 0)
+                    goto done;
+            }
+            else
+            {
+                x[dest++] = buffer[cursor1++];
+                count1++;
+                count2 = 0;
+                if (--length1 == 1)
+                    goto done;
+            }
+        } while ((count1 | count2) < minGallop);
+
+        // galloping: search where the next element of one run goes in the other and copy the whole stretch
+        do
+        {
+            count1 = gallopRight(x[cursor2], &buffer[cursor1], length1, 0);
+            if (count1 != 0)
+            {
+                memcpy(&x[dest], &buffer[cursor1], count1 * sizeof(int));
+                dest += count1;
+                cursor1 += count1;
+                length1 -= count1;
+                if (length1 <= 1)
+                    goto done;
+            }
+            x[dest++] = x[cursor2++];
+            if (--length2 == 0)
+                goto done;
+
+            count2 = gallopLeft(buffer[cursor1], &x[cursor2], length2, 0);
+            if (count2 != 0)
+            {
+                memmove(&x[dest], &x[cursor2], count2 * sizeof(int));
+                dest += count2;
+                cursor2 += count2;
+                length2 -= count2;
+                if (length2 == 0)
+                    goto done;
+            }
+            x[dest++] = buffer[cursor1++];
+            if (--length1 == 1)
+                goto done;
+            minGallop--; // galloping pays off, make it easier to enter next time
+        } while (count1 >= MIN_GALLOP || count2 >= MIN_GALLOP);
+
+        if (minGallop < 0)
+            minGallop = 0;
+        minGallop += 2; // penalty for leaving galloping mode
+    }
+
+done:
+    sorter->minGallop = minGallop < 1 ? 1 : minGallop;
+    if (length1 == 1)
+    {
+        memmove(&x[dest], &x[cursor2], length2 * sizeof(int));
+        x[dest + length2] = buffer[cursor1];
+    }
+    else
+    {
+        memcpy(&x[dest], &buffer[cursor1], length1 * sizeof(int));
+    }
+}
+
+/*
+Same as mergeLow for length1 > length2: the second run goes to the buffer and the merge runs back to front
+*/
+static void mergeHigh(struct adaptiveSorter *sorter, int x[], int base1, int length1, int base2, int length2)
+{
+    int *buffer = sorter->buffer;
+    int cursor1 = base1 + length1 - 1; // in x
+    int cursor2 = length2 - 1;         // in the buffer
+    int dest = base2 + length2 - 1;
+    int minGallop = sorter->minGallop;
+
+    memcpy(buffer, &x[base2], length2 * sizeof(int));
+    x[dest--] = x[cursor1--];
+    if (--length1 == 0)
+    {
+        memcpy(&x[dest - (length2 - 1)], buffer, length2 * sizeof(int));
+        return;
+    }
+    if (length2 == 1)
+    {
+        dest -= length1;
+        cursor1 -= length1;
+        memmove(&x[dest + 1], &x[cursor1 + 1], length1 * sizeof(int));
+        x[dest] = buffer[cursor2];
+        return;
+    }
+
+    while (1)
+    {
+        int count1 = 0;
+        int count2 = 0;
+
+        do
+        {
+            if (buffer[cursor2] < x[cursor1])
+            {
+                x[dest--] = x[cursor1--];
+                count1++;
+                count2 = 0;
+                if (--length1 == 0)
+                    goto done;
+            }
+            else
+            {
+                x[dest--] = buffer[cursor2--];
+                count2++;
+                count1 = 0;
+                if (--length2 == 1)
+                    goto done;
+            }
+        } while ((count1 | count2) < minGallop);
+
+        do
+        {
+            count1 = length1 - gallopRight(buffer[cursor2], &x[base1], length1, length1 - 1);
+            if (count1 != 0)
+            {
+                dest -= count1;
+                cursor1 -= count1;
+                length1 -= count1;
+                memmove(&x[dest + 1], &x[cursor1 + 1], count1 * sizeof(int));
+                if (length1 == 0)
+                    goto done;
+            }
+            x[dest--] = buffer[cursor2--];
+            if (--length2 == 1)
+                goto done;
+
+            count2 = length2 - gallopLeft(x[cursor1], buffer, length2, length2 - 1);
+            if (count2 != 0)
+            {
+                dest -= count2;
+                cursor2 -= count2;
+                length2 -= count2;
+                memcpy(&x[dest + 1], &buffer[cursor2 + 1], count2 * sizeof(int));
+                if (length2 <= 1)
+                    goto done;
+            }
+            x[dest--] = x[cursor1--];
+            if (--length1 == 0)
+                goto done;
+            minGallop--;
+        } while (count1 >= MIN_GALLOP || count2 >= MIN_GALLOP);
+
+        if (minGallop < 0)
+            minGallop = 0;
+        minGallop += 2;
+    }
+
+done:
+    sorter->minGallop = minGallop < 1 ? 1 : minGallop;
+    if (length2 == 1)
+    {
+        dest -= length1;
+        cursor1 -= length1;
+        memmove(&x[dest + 1], &x[cursor1 + 1], length1 * sizeof(int));
+        x[dest] = buffer[cursor2];
+    }
+    else
+    {
+        memcpy(&x[dest - (length2 - 1)], buffer, length2 * sizeof(int));
+    }
+}
+
+/*
+Merges run i and i + 1 of the stack. Elements of run 1 that are already before all of run 2, and elements
+of run 2 that are already after all of run 1, are found by galloping and left where they are.
+*/
+static void mergeAt(struct adaptiveSorter *sorter, int x[], int i)
+{
+    struct sortRun *runs = sorter->runs;
+    int base1 = runs[i].base;
+    int length1 = runs[i].length;
+    int base2 = runs[i + 1].base;
+    int length2 = runs[i + 1].length;
+
+    runs[i].length = length1 + length2;
+    if (i == sorter->runCount - 3)
+    {
+        runs[i + 1] = runs[i + 2];
+    }
+    sorter->runCount--;
+
+    int skip = gallopRight(x[base2], &x[base1], length1, 0);
+    base1 += skip;
+    length1 -= skip;
+    if (length1 == 0)
+    {
+        return; // the runs were already in order
+    }
+
+    length2 = gallopLeft(x[base1 + length1 - 1], &x[base2], length2, length2 - 1);
+    if (length2 == 0)
+    {
+        return;
+    }
+
+    if (length1 <= length2)
+        mergeLow(sorter, x, base1, length1, base2, length2);
+    else
+        mergeHigh(sorter, x, base1, length1, base2, length2);
+}
+
+/*
+Merges runs until the stack lengths satisfy, for the top runs A, B, C, D (D on top):
+B > C + D, A > B + C and C > D. This keeps the merges balanced and the stack depth logarithmic.
+The A > B + C check is the one that was missing from the original TimSort.
+*/
+static void mergeCollapse(struct adaptiveSorter *sorter, int x[])
+{
+    struct sortRun *runs = sorter->runs;
+
+    while (sorter->runCount > 1)
+    {
+        int n = sorter->runCount - 2;
+
+        if ((n > 0 && runs[n - 1].length <= runs[n].length + runs[n + 1].length) ||
+            (n > 1 && runs[n - 2].length <= runs[n - 1].length + runs[n].length))
+        {
+            if (runs[n - 1].length < runs[n + 1].length)
+                n--;
+        }
+        else if (runs[n].length > runs[n + 1].length)
+        {
+            break;
+        }
+        mergeAt(sorter, x, n);
+    }
+}
+
+/*
+Merges all remaining runs at the end of the sort
+*/
+static void mergeForceCollapse(struct adaptiveSorter *sorter, int x[])
+{
+    struct sortRun *runs = sorter->runs;
+
+    while (sorter->runCount > 1)
+    {
+        int n = sorter->runCount - 2;
+
+        if (n > 0 && runs[n - 1].length < runs[n + 1].length)
+            n--;
+        mergeAt(sorter, x, n);
+    }
+}
+
+/*
+Sorts x[0..n) in ascending order, keeping equal elements in their original order.
+Returns 0 on success, -1 if n is longer than the sorter was initialised for.
+*/
+int adaptiveSort(struct adaptiveSorter *sorter, int x[], int n)
+{
+    int low = 0;
+    int remaining = n;
+
+    if (n > sorter->maxLength)
+    {
+        return -1;
+    }
+    if (n < 2)
+    {
+        return 0;
+    }
+    if (n < MIN_MERGE)
+    {
+        binaryInsertionSort(x, 0, n, countRun(x, 0, n));
+        return 0;
+    }
+
+    int minRun = minRunLength(n);
+    sorter->runCount = 0;
+    sorter->minGallop = MIN_GALLOP;
+
+    do
+    {
+        int length = countRun(x, low, n);
+
+        // short runs are extended to minRun so there are not too many merges
+        if (length < minRun)
+        {
+            int forced = remaining <= minRun ? remaining : minRun;
+            binaryInsertionSort(x, low, low + forced, low + length);
+            length = forced;
+        }
+
+        sorter->runs[sorter->runCount++] = (struct sortRun){low, length};
+        mergeCollapse(sorter, x);
+        low += length;
+        remaining -= length;
+    } while (remaining != 0);
+
+    mergeForceCollapse(sorter, x);
+    return 0;
+}
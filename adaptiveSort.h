@@ -0,0 +1,36 @@
+/*
+adaptiveSort.h
+
+Adaptive stable sort for int arrays (TimSort style).
+The array is split into natural runs: ascending runs are kept, strictly descending runs are reversed,
+and runs shorter than minrun are extended with binary insertion sort. The runs are merged from a stack
+that keeps the TimSort length invariants, and merges switch to galloping (exponential search) when one
+run keeps winning. Sorted and nearly sorted input is handled in close to O(n).
+The merge buffer is allocated once by initAdaptiveSorter and reused by every sort.
+*/
+
+#ifndef ADAPTIVE_SORT_H
+#define ADAPTIVE_SORT_H
+
+#define SORT_MAX_RUNS 85 // run stack depth, enough for any array that fits in memory
+
+struct sortRun
+{
+    int base;
+    int length;
+};
+
+struct adaptiveSorter
+{
+    int *buffer;   // merge buffer, holds the shorter run of a merge
+    int maxLength; // longest array the buffer is big enough for
+    int minGallop; // adaptive threshold for entering galloping mode
+    struct sortRun runs[SORT_MAX_RUNS];
+    int runCount;
+};
+
+int initAdaptiveSorter(struct adaptiveSorter *sorter, int maxLength);
+void freeAdaptiveSorter(struct adaptiveSorter *sorter);
+int adaptiveSort(struct adaptiveSorter *sorter, int x[], int n);
+
+#endif
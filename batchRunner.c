@@ -0,0 +1,230 @@
+/*
+batchRunner.c
+
+Work queue over a list of capture files, see batchRunner.h.
+The queue is the index of the next file; each worker takes the next file with an atomic increment,
+so there is no lock and threads that get short files simply take more of them.
+*/
+
+// header files
+#include <glob.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "batchRunner.h"
+#include "captureStore.h"
+#include "pngRenderer.h"
+#include "waveAnalyser.h"
+
+// DEFINITIONS
+#define PATH_LENGTH 4096
+#define MAX_THREADS 64
+
+struct batchResult
+{
+    int loaded;             // 1 if the file was read
+    int rendered;           // 1 if the PNG was written
+    size_t samples;
+    struct captureRun run;  // configuration of the first run
+    struct pairStats stats; // measured behaviour
+};
+
+struct batchQueue
+{
+    char **files;
+    size_t fileCount;
+    size_t next; // index of the next file to take, advanced atomically
+    int render;
+    struct batchResult *results;
+};
+
+/*
+Output name for a capture: the .csv suffix is replaced by .png
+*/
+static void pngNameFor(const char *fileName, char *pngName, size_t size)
+{
+    const char *dot = strrchr(fileName, '.');
+    int length = dot != NULL && strcmp(dot, ".csv") == 0 ? (int)(dot - fileName) : (int)strlen(fileName);
+
+    snprintf(pngName, size, "%.*s.png", length, fileName);
+}
+
+static void *batchWorker(void *arg)
+{
+    struct batchQueue *queue = arg;
+    struct captureStore store; // reused for every file so the columns are only allocated once per thread
+    char pngName[PATH_LENGTH];
+
+    initCaptureStore(&store);
+
+    for (;;)
+    {
+        size_t i = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED);
+        if (i >= queue->fileCount)
+        {
+            break;
+        }
+
+        struct batchResult *result = &queue->results[i];
+        memset(result, 0, sizeof(*result));
+        clearCaptureStore(&store);
+
+        if (loadCaptureFile(&store, queue->files[i]) < 0)
+        {
+            continue;
+        }
+        result->loaded = 1;
+        result->samples = store.count;
+        if (store.runCount > 0)
+        {
+            result->run = store.runs[0];
+        }
+        analyseCapture(&store, 0, store.count, &result->stats);
+
+        if (queue->render && store.count > 0)
+        {
+            pngNameFor(queue->files[i], pngName, sizeof(pngName));
+            result->rendered = renderCapturePng(&store, 0, store.count, &result->stats, pngName) == 0;
+        }
+    }
+
+    freeCaptureStore(&store);
+    return NULL;
+}
+
+/*
+Processes every file of the queue with the given number of threads. Returns the wall-clock seconds taken.
+*/
+static double processQueue(struct batchQueue *queue, int threads)
+{
+    pthread_t workers[MAX_THREADS];
+    struct timespec start, end;
+    int started = 0;
+
+    queue->next = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int t = 0; t < threads; t++)
+    {
+        if (pthread_create(&workers[t], NULL, batchWorker, queue) == 0)
+        {
+            started++;
+        }
+    }
+    if (started == 0)
+    {
+        batchWorker(queue); // no threads available, work through the queue here
+    }
+    for (int t = 0; t < started; t++)
+    {
+        pthread_join(workers[t], NULL);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static void printSummary(const struct batchQueue *queue)
+{
+    printf("\n%-40s %8s | %-27s | %-27s\n", "", "", "Green LED", "Red LED");
+    printf("%-40s %8s | %5s %6s %6s %6s | %5s %6s %6s %6s\n", "file", "samples",
+           "Hz", "meas", "duty", "meas", "Hz", "meas", "duty", "meas");
+
+    for (size_t i = 0; i < queue->fileCount; i++)
+    {
+        const struct batchResult *result = &queue->results[i];
+        const char *name = queue->files[i];
+
+        // keep the end of long paths, that is where the file names differ
+        if (strlen(name) > 40)
+        {
+            name += strlen(name) - 40;
+        }
+        if (!result->loaded)
+        {
+            printf("%-40s cannot be read\n", name);
+            continue;
+        }
+        printf("%-40s %8zu | %5u %6.2f %5.1f%% %5.1f%% | %5u %6.2f %5.1f%% %5.1f%%\n", name, result->samples,
+               result->run.greenFrequency, measuredFrequency(&result->stats.green),
+               result->run.greenDutyCycle, measuredDutyCycle(&result->stats.green),
+               result->run.redFrequency, measuredFrequency(&result->stats.red),
+               result->run.redDutyCycle, measuredDutyCycle(&result->stats.red));
+    }
+}
+
+/*
+Batch mode. pattern is a directory (all *.csv files in it) or a glob. With render set a PNG is written
+next to every capture. With scaling set the batch is also run with 1, 2, 4, ... threads up to threads,
+to show how the throughput scales. Returns 0 on success, 1 on error.
+*/
+int runBatch(const char *pattern, int threads, int render, int scaling)
+{
+    char globPattern[PATH_LENGTH];
+    struct stat info;
+    glob_t matches;
+
+    if (stat(pattern, &info) == 0 && S_ISDIR(info.st_mode))
+    {
+        snprintf(globPattern, sizeof(globPattern), "%s/*.csv", pattern);
+    }
+    else
+    {
+        snprintf(globPattern, sizeof(globPattern), "%s", pattern);
+    }
+
+    if (glob(globPattern, 0, NULL, &matches) != 0 || matches.gl_pathc == 0)
+    {
+        printf("No capture files match %s\n", globPattern);
+        globfree(&matches);
+        return 1;
+    }
+
+    if (threads <= 0)
+    {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    threads = threads < 1 ? 1 : threads > MAX_THREADS ? MAX_THREADS : threads;
+
+    struct batchQueue queue = {matches.gl_pathv, matches.gl_pathc, 0, render, NULL};
+    queue.results = calloc(queue.fileCount, sizeof(struct batchResult));
+    if (queue.results == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed");
+        globfree(&matches);
+        return 1;
+    }
+
+    double seconds = processQueue(&queue, threads);
+    printSummary(&queue);
+    printf("\n%zu files with %d threads in %.3f s, %.1f files/s\n", queue.fileCount, threads, seconds, queue.fileCount / seconds);
+
+    if (scaling)
+    {
+        double single = 0;
+
+        printf("\n%8s %10s %8s %10s\n", "threads", "files/s", "speedup", "efficiency");
+        for (int t = 1;; t *= 2)
+        {
+            t = t > threads ? threads : t;
+            double rate = queue.fileCount / processQueue(&queue, t);
+            if (t == 1)
+            {
+                single = rate;
+            }
+            printf("%8d %10.1f %7.2fx %9.0f%%\n", t, rate, rate / single, 100.0 * rate / single / t);
+            if (t == threads)
+            {
+                break;
+            }
+        }
+    }
+
+    free(queue.results);
+    globfree(&matches);
+    return 0;
+}
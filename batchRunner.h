@@ -0,0 +1,13 @@
+/*
+batchRunner.h
+
+Batch mode for displayPlot: loads, analyses and optionally renders every capture in a directory or glob
+on a pool of worker threads, then prints one summary table of configured against measured values.
+*/
+
+#ifndef BATCH_RUNNER_H
+#define BATCH_RUNNER_H
+
+int runBatch(const char *pattern, int threads, int render, int scaling);
+
+#endif
@@ -0,0 +1,422 @@
+/*
+captureStore.c
+
+Loading and growing the columnar capture store, see captureStore.h.
+*/
+
+// header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "captureStore.h"
+
+// DEFINITIONS
+#define LINE_LENGTH 256          // Assume maximum line length of 256
+#define INITIAL_CAPACITY 4096    // samples allocated by the first append
+#define INITIAL_RUN_CAPACITY 8   // runs allocated by the first append
+
+void initCaptureStore(struct captureStore *store)
+{
+    memset(store, 0, sizeof(*store));
+}
+
+void freeCaptureStore(struct captureStore *store)
+{
+    free(store->time);
+    free(store->greenState);
+    free(store->redState);
+    free(store->runs);
+    initCaptureStore(store);
+}
+
+/*
+Forgets all samples but keeps the allocated columns for reuse
+*/
+void clearCaptureStore(struct captureStore *store)
+{
+    store->count = 0;
+    store->runCount = 0;
+}
+
+/*
+Doubles the capacity of the sample columns. Returns 0 on success, -1 if memory ran out.
+*/
+static int growColumns(struct captureStore *store)
+{
+    size_t capacity = store->capacity ? store->capacity * 2 : INITIAL_CAPACITY;
+    size_t oldWords = store->capacity / 64;
+    size_t words = capacity / 64;
+
+    uint32_t *time = realloc(store->time, capacity * sizeof(uint32_t));
+    if (time == NULL)
+    {
+        return -1;
+    }
+    store->time = time;
+
+    uint64_t *greenState = realloc(store->greenState, words * sizeof(uint64_t));
+    if (greenState == NULL)
+    {
+        return -1;
+    }
+    store->greenState = greenState;
+
+    uint64_t *redState = realloc(store->redState, words * sizeof(uint64_t));
+    if (redState == NULL)
+    {
+        return -1;
+    }
+    store->redState = redState;
+
+    // new state words start cleared so appending only has to set bits
+    memset(store->greenState + oldWords, 0, (words - oldWords) * sizeof(uint64_t));
+    memset(store->redState + oldWords, 0, (words - oldWords) * sizeof(uint64_t));
+    store->capacity = capacity;
+    return 0;
+}
+
+/*
+Starts a new run if the configuration of the row differs from the current run. Returns -1 if memory ran out.
+*/
+static int updateRun(struct captureStore *store, const double values[CAPTURE_COLUMNS])
+{
+    uint16_t greenFrequency = (uint16_t)values[COL_FREQUENCY];
+    uint16_t redFrequency = (uint16_t)values[RED_COLUMN + COL_FREQUENCY];
+    float greenDutyCycle = (float)values[COL_DUTY];
+    float redDutyCycle = (float)values[RED_COLUMN + COL_DUTY];
+
+    if (store->runCount > 0)
+    {
+        struct captureRun *run = &store->runs[store->runCount - 1];
+        if (run->greenFrequency == greenFrequency && run->redFrequency == redFrequency &&
+            run->greenDutyCycle == greenDutyCycle && run->redDutyCycle == redDutyCycle)
+        {
+            run->sampleCount++;
+            return 0;
+        }
+    }
+
+    if (store->runCount == store->runCapacity)
+    {
+        size_t runCapacity = store->runCapacity ? store->runCapacity * 2 : INITIAL_RUN_CAPACITY;
+        struct captureRun *runs = realloc(store->runs, runCapacity * sizeof(struct captureRun));
+        if (runs == NULL)
+        {
+            return -1;
+        }
+        store->runs = runs;
+        store->runCapacity = runCapacity;
+    }
+
+    store->runs[store->runCount++] = (struct captureRun){(uint32_t)store->count, 1, greenFrequency, redFrequency, greenDutyCycle, redDutyCycle};
+    return 0;
+}
+
+/*
+Appends one CSV row to the store. Returns 0 on success, -1 if memory ran out.
+*/
+int appendSample(struct captureStore *store, const double values[CAPTURE_COLUMNS])
+{
+    if (store->count == store->capacity && growColumns(store) != 0)
+    {
+        return -1;
+    }
+    if (updateRun(store, values) != 0)
+    {
+        return -1;
+    }
+
+    size_t i = store->count++;
+    uint64_t bit = (uint64_t)1 << (i & 63);
+
+    store->time[i] = (uint32_t)values[COL_TIME];
+    if (values[COL_STATE] != 0)
+    {
+        store->greenState[i >> 6] |= bit;
+    }
+    else
+    {
+        store->greenState[i >> 6] &= ~bit;
+    }
+    if (values[RED_COLUMN + COL_STATE] != 0)
+    {
+        store->redState[i >> 6] |= bit;
+    }
+    else
+    {
+        store->redState[i >> 6] &= ~bit;
+    }
+    return 0;
+}
+
+/*
+Parses one comma separated data row. Returns 1 if the row has exactly CAPTURE_COLUMNS numbers,
+0 for the header row, blank lines, incomplete rows and rows with anything after the last number.
+*/
+int parseCaptureRow(const char *line, double values[CAPTURE_COLUMNS])
+{
+    const char *p = line;
+
+    for (int col = 0; col < CAPTURE_COLUMNS; col++)
+    {
+        char *end;
+
+        values[col] = strtod(p, &end);
+        if (end == p)
+        {
+            return 0; // not a number
+        }
+        p = end;
+        if (col < CAPTURE_COLUMNS - 1)
+        {
+            if (*p != ',')
+            {
+                return 0;
+            }
+            p++;
+        }
+    }
+
+    // only the line ending may follow the last column
+    while (*p == ' ' || *p == '\r' || *p == '\n')
+    {
+        p++;
+    }
+    return *p == '\0';
+}
+
+/*
+Reads a whole capture file into the store. Returns the number of samples, or -1 on error.
+*/
+int loadCaptureFile(struct captureStore *store, const char *fileName)
+{
+    return loadCaptureRange(store, fileName, 0, CAPTURE_END);
+}
+
+/*
+Appends one record to a capture index. offset is the byte offset in the capture at which
+the row with the given time (or the newline in front of it) starts.
+*/
+void writeIndexRecord(FILE *indexFile, uint32_t time, long offset)
+{
+    // 10 + 1 + 20 + 1 = INDEX_RECORD_LENGTH
+    fprintf(indexFile, "%010u %020ld\n", (unsigned)time, offset);
+}
+
+/*
+Reads record number i of an index. Returns 1 on success.
+*/
+static int readIndexRecord(FILE *indexFile, long i, uint32_t *time, long *offset)
+{
+    unsigned recordTime;
+
+    if (fseek(indexFile, i * INDEX_RECORD_LENGTH, SEEK_SET) != 0 || fscanf(indexFile, "%u %ld", &recordTime, offset) != 2)
+    {
+        return 0;
+    }
+    *time = recordTime;
+    return 1;
+}
+
+/*
+Finds the byte offset to start reading at for a window beginning at time from.
+Binary searches <fileName>.idx for the last record at or before from, and checks that the capture
+really has a row with that time at that offset. Returns 0 (read from the start) if there is no usable index.
+*/
+static long findStartOffset(FILE *csvFile, const char *fileName, uint32_t from)
+{
+    char indexName[LINE_LENGTH];
+    char line[LINE_LENGTH];
+    double values[CAPTURE_COLUMNS];
+    uint32_t time = 0;
+    long offset = 0;
+
+    snprintf(indexName, sizeof(indexName), "%s%s", fileName, INDEX_SUFFIX);
+    FILE *indexFile = fopen(indexName, "r");
+    if (indexFile == NULL)
+    {
+        return 0;
+    }
+
+    fseek(indexFile, 0, SEEK_END);
+    long low = 0;
+    long high = ftell(indexFile) / INDEX_RECORD_LENGTH - 1;
+    long found = -1;
+
+    while (low <= high)
+    {
+        long mid = low + (high - low) / 2;
+        uint32_t midTime;
+        long midOffset;
+
+        if (!readIndexRecord(indexFile, mid, &midTime, &midOffset))
+        {
+            found = -1;
+            break;
+        }
+        if (midTime <= from)
+        {
+            found = mid;
+            time = midTime;
+            offset = midOffset;
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid - 1;
+        }
+    }
+    fclose(indexFile);
+
+    if (found < 0)
+    {
+        return 0;
+    }
+
+    // the index may be stale if the capture was rewritten, so check the row it points at
+    if (fseek(csvFile, offset, SEEK_SET) == 0)
+    {
+        while (fgets(line, sizeof(line), csvFile))
+        {
+            if (parseCaptureRow(line, values))
+            {
+                if ((uint32_t)values[COL_TIME] == time)
+                {
+                    return offset;
+                }
+                break;
+            }
+            if (line[0] != '\n' && line[0] != '\r')
+            {
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+Reads the samples with from <= time <= to into the store. With an index only the rows from the
+nearest index record before from are read, so the cost follows the window size and not the file size.
+Returns the number of samples in the store, or -1 on error.
+*/
+int loadCaptureRange(struct captureStore *store, const char *fileName, uint32_t from, uint32_t to)
+{
+    char line[LINE_LENGTH];
+    double values[CAPTURE_COLUMNS];
+    FILE *csvFile = fopen(fileName, "r");
+
+    if (csvFile == NULL)
+    {
+        return -1;
+    }
+
+    long offset = from > 0 ? findStartOffset(csvFile, fileName, from) : 0;
+    fseek(csvFile, offset, SEEK_SET);
+
+    while (fgets(line, sizeof(line), csvFile))
+    {
+        if (!parseCaptureRow(line, values) || values[COL_TIME] < from)
+        {
+            continue;
+        }
+        if (values[COL_TIME] > to)
+        {
+            break; // rows are in time order, the rest of the file is after the window
+        }
+        if (appendSample(store, values) != 0)
+        {
+            fclose(csvFile);
+            return -1;
+        }
+    }
+
+    fclose(csvFile);
+    return (int)store->count;
+}
+
+/*
+Writes <fileName>.idx for a capture that was recorded without an index.
+Returns the number of index records, or -1 on error.
+*/
+int buildCaptureIndex(const char *fileName)
+{
+    char indexName[LINE_LENGTH];
+    char line[LINE_LENGTH];
+    double values[CAPTURE_COLUMNS];
+    long rows = 0;
+    int records = 0;
+
+    FILE *csvFile = fopen(fileName, "r");
+    if (csvFile == NULL)
+    {
+        return -1;
+    }
+
+    snprintf(indexName, sizeof(indexName), "%s%s", fileName, INDEX_SUFFIX);
+    FILE *indexFile = fopen(indexName, "w");
+    if (indexFile == NULL)
+    {
+        fclose(csvFile);
+        return -1;
+    }
+
+    long offset = ftell(csvFile);
+    while (fgets(line, sizeof(line), csvFile))
+    {
+        if (parseCaptureRow(line, values) && rows++ % INDEX_INTERVAL == 0)
+        {
+            writeIndexRecord(indexFile, (uint32_t)values[COL_TIME], offset);
+            records++;
+        }
+        offset = ftell(csvFile);
+    }
+
+    fclose(indexFile);
+    fclose(csvFile);
+    return records;
+}
+
+/*
+Heap memory held by the store
+*/
+size_t captureStoreBytes(const struct captureStore *store)
+{
+    return store->capacity * sizeof(uint32_t) + 2 * (store->capacity / 64) * sizeof(uint64_t) +
+           store->runCapacity * sizeof(struct captureRun);
+}
+
+/*
+The run a sample belongs to, NULL if the store is empty
+*/
+const struct captureRun *captureRunAt(const struct captureStore *store, size_t sample)
+{
+    const struct captureRun *run = store->runCount > 0 ? &store->runs[0] : NULL;
+
+    for (size_t r = 1; r < store->runCount && store->runs[r].firstSample <= sample; r++)
+    {
+        run = &store->runs[r];
+    }
+    return run;
+}
+
+/*
+Runs the waveform analyser over count samples starting at first, scanning the time and state columns
+*/
+void analyseCapture(const struct captureStore *store, size_t first, size_t count, struct pairStats *stats)
+{
+    // the configured frequency and duty cycle are taken from the run of the first sample
+    const struct captureRun *run = captureRunAt(store, first);
+
+    if (count == 0 || run == NULL)
+    {
+        initPairStats(stats, 0, 0, 0, 0);
+        return;
+    }
+    initPairStats(stats, run->greenFrequency, run->greenDutyCycle, run->redFrequency, run->redDutyCycle);
+
+    for (size_t i = first; i < first + count; i++)
+    {
+        updatePairStats(stats, store->time[i], sampleState(store->greenState, i), sampleState(store->redState, i));
+    }
+}
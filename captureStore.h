@@ -0,0 +1,78 @@
+/*
+captureStore.h
+
+Columnar in-memory store for LED waveform captures.
+Instead of keeping every CSV field as text, a capture is kept as contiguous typed columns:
+  - one uint32 millisecond timestamp per sample (the green and red time columns are identical)
+  - one bit per sample and LED for the state
+  - one run record per stretch of samples with the same configured frequency and duty cycle
+That is about 4.25 bytes per sample. The columns grow by doubling, so there is no row limit.
+*/
+
+#ifndef CAPTURE_STORE_H
+#define CAPTURE_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "waveAnalyser.h"
+
+// layout of displayPlot.csv: 4 green columns followed by 4 red columns
+#define CAPTURE_COLUMNS 8 // number of columns in the CSV file
+#define RED_COLUMN 4      // first red LED column
+#define COL_TIME 0        // time iteration in milliseconds
+#define COL_FREQUENCY 1   // configured frequency in Hz
+#define COL_DUTY 2        // configured duty cycle in percent
+#define COL_STATE 3       // LED state, 0 or 1
+
+// sparse time index written next to a capture as <capture>.idx
+// every record is "<time ms> <byte offset>\n" padded to a fixed width, so it can be binary searched with fseek
+#define INDEX_SUFFIX ".idx"
+#define INDEX_INTERVAL 100      // one record every 100 rows (1 second at 10 ms per sample)
+#define INDEX_RECORD_LENGTH 32  // bytes per index record
+#define CAPTURE_END UINT32_MAX  // "to" time that reads up to the end of the capture
+
+/* Configuration shared by a contiguous stretch of samples */
+struct captureRun
+{
+    uint32_t firstSample;
+    uint32_t sampleCount;
+    uint16_t greenFrequency;
+    uint16_t redFrequency;
+    float greenDutyCycle;
+    float redDutyCycle;
+};
+
+struct captureStore
+{
+    uint32_t *time;       // sample timestamps in milliseconds
+    uint64_t *greenState; // bit i holds the green LED state of sample i
+    uint64_t *redState;   // bit i holds the red LED state of sample i
+    size_t count;         // number of samples
+    size_t capacity;      // samples the columns can hold before growing
+
+    struct captureRun *runs;
+    size_t runCount;
+    size_t runCapacity;
+};
+
+void initCaptureStore(struct captureStore *store);
+void freeCaptureStore(struct captureStore *store);
+void clearCaptureStore(struct captureStore *store);
+int appendSample(struct captureStore *store, const double values[CAPTURE_COLUMNS]);
+int parseCaptureRow(const char *line, double values[CAPTURE_COLUMNS]);
+int loadCaptureFile(struct captureStore *store, const char *fileName);
+int loadCaptureRange(struct captureStore *store, const char *fileName, uint32_t from, uint32_t to);
+void writeIndexRecord(FILE *indexFile, uint32_t time, long offset);
+int buildCaptureIndex(const char *fileName);
+size_t captureStoreBytes(const struct captureStore *store);
+const struct captureRun *captureRunAt(const struct captureStore *store, size_t sample);
+void analyseCapture(const struct captureStore *store, size_t first, size_t count, struct pairStats *stats);
+
+/* State bit of sample i in a state column */
+static inline int sampleState(const uint64_t *column, size_t i)
+{
+    return (column[i >> 6] >> (i & 63)) & 1;
+}
+
+#endif
@@ -7,118 +7,241 @@ and displays the data in graphs using GNUplot
 === HOW TO RUN ===
 Step 1: cd into C file location
 Step 2: scp -P 22  piusername@ipaddress:displayPlot.csv .
-Step 3: gcc -o displayPlot displayPlot.c
+Step 3: gcc -o displayPlot displayPlot.c batchRunner.c captureStore.c pngRenderer.c waveAnalyser.c -lm -pthread
 Step 4: ./displayPlot
 
+=== OPTIONS ===
+./displayPlot --binary   send the samples to gnuplot as raw float64 records instead of text
+./displayPlot --bench    time-to-first-plot of the text and binary paths for 10^4 to 10^7 points
+./displayPlot --from 42 --to 43   load and plot only seconds 42 to 43, using displayPlot.csv.idx to seek if it exists
+./displayPlot --png waveform.png   draw the plot into a PNG file with the built-in renderer, gnuplot is not needed
+./displayPlot --batch <dir|glob> [--threads N] [--render] [--scaling]
+                         analyse every capture on a thread pool and print one summary table,
+                         --render writes a PNG next to each capture, --scaling reports files/s for 1, 2, 4 ... threads
+./displayPlot --index    write displayPlot.csv.idx for a capture that was recorded without one
+./displayPlot --live-socket [path]   plot the samples newStudent streams to a Unix socket (default /tmp/displayPlot.sock)
+
 === PRE-REQUISITES ===
 Install gnuPlot: https://riptutorial.com/gnuplot/example/11275/installation-or-setup
 */
 
 // header files
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "batchRunner.h"
+#include "captureStore.h"
+#include "pngRenderer.h"
+#include "waveAnalyser.h"
 
 // DEFINITIONS
 #define LINE_LENGTH 256 // Assume maximum line length of 256
-#define MAX_ROWS 300    // Maximum number of rows
-#define MAX_COLUMNS 8   // Number of columns in CSV file
-#define MIDDLE_COL 4    // variable to split the data into green and red LED data arrays
 
-// function prototypes
-void gnuPlot(char greenData[MAX_ROWS][MIDDLE_COL][LINE_LENGTH], char redData[MAX_ROWS][MIDDLE_COL][LINE_LENGTH], int max_rows);
+#define PIPE_BUFFER_SIZE (1 << 20) // stdio buffer for the gnuplot pipe so data goes out in large writes
+#define BINARY_CHUNK 65536         // number of (x, y) pairs packed per fwrite in binary mode
+#define BENCH_MIN_POINTS 10000     // smallest benchmark size (10^4)
+#define BENCH_MAX_POINTS 10000000  // largest benchmark size (10^7)
 
-// main function
-int main()
-{
-    // initialise variables
-    char values[LINE_LENGTH];                          // size of 256 characters for each line of data
-    char greenData[MAX_ROWS][MIDDLE_COL][LINE_LENGTH]; // array to store the csv data
-    char redData[MAX_ROWS][MIDDLE_COL][LINE_LENGTH];   // array to store the csv data
+#define LIVE_WINDOW 1000                           // samples shown in the scrolling live plot (10 s at 10 ms per sample)
+#define LIVE_REFRESH_MS 100                        // live plot refresh period
+#define LIVE_SOCKET_PATH "/tmp/displayPlot.sock"   // must match LIVE_SOCKET_PATH in newStudent.c
 
-    int row = 0; // Current row in CSV
-    int col = 0; // Current column in CSV
+/* Scrolling window of the latest samples for the live plot */
+struct liveWindow
+{
+    double time[LIVE_WINDOW];  // ring buffer of sample times
+    double green[LIVE_WINDOW]; // ring buffer of green LED states
+    double red[LIVE_WINDOW];   // ring buffer of red LED states
+    int head;                  // next slot to write
+    int count;                 // number of valid samples in the ring
+    int dirty;                 // new samples since the last refresh
+    long samples;              // total samples received
+    char pending[LINE_LENGTH]; // partial line waiting for its newline
+    size_t pendingLength;
+    struct pairStats stats; // analysis over the whole live capture, not only the window
+};
 
-    // open the csv file
-    FILE *csvFile = fopen("displayPlot.csv", "r");
+// function prototypes
+void gnuPlot(const struct captureStore *store, const struct pairStats *stats, int binaryMode);
+FILE *openGnuplotPipe();
+void plotSource(char *source, size_t size, int count, int binaryMode);
+void sendPoint(FILE *gnuplotPipe, double x, double y, int binaryMode);
+void endPlotData(FILE *gnuplotPipe, int binaryMode);
+void sendPlotData(FILE *gnuplotPipe, const double *x, const double *y, int stride, int count, int binaryMode);
+void sendStateColumn(FILE *gnuplotPipe, const struct captureStore *store, const uint64_t *state, size_t first, size_t count, int binaryMode);
+double elapsedSeconds(struct timespec start, struct timespec end);
+void benchmarkPlot();
+long monotonicMillis();
+void resetLiveWindow(struct liveWindow *window);
+void parseLiveLine(struct liveWindow *window, char *line);
+void consumeLiveData(struct liveWindow *window, const char *data, size_t length);
+void refreshLivePlot(FILE *gnuplotPipe, struct liveWindow *window, int binaryMode);
+int openLiveSocket(const char *socketPath);
+int livePlot(const char *socketPath, int binaryMode);
+void stopLivePlot(int signalNumber);
 
-    // check if file exists
-    if (csvFile == NULL)
-    {
-        printf("Error opening file! File does not exist!\n");
-        return 1;
-    }
+static volatile sig_atomic_t liveStopped = 0; // set by Ctrl+C to leave the live loop
 
-    // Skip CSV header row
-    fgets(values, sizeof(values), csvFile);
+// main function
+int main(int argc, char *argv[])
+{
+    // initialise variables
+    struct captureStore store;   // the capture as typed columns
+    int binaryMode = 0;          // send data to gnuplot as binary records instead of text
+    uint32_t from = 0;           // start of the time window in milliseconds
+    uint32_t to = CAPTURE_END;   // end of the time window in milliseconds
+    const char *pngFile = NULL;  // render to this PNG file instead of opening gnuplot
+    const char *batch = NULL;    // directory or glob of captures for batch mode
+    int threads = 0;             // batch worker threads, 0 for one per CPU
+    int render = 0;              // batch mode writes a PNG for every capture
+    int scaling = 0;             // batch mode measures throughput for 1, 2, 4 ... threads
 
-    // read CSV file line by line
-    while (fgets(values, sizeof(values), csvFile))
+    // read command line options
+    for (int i = 1; i < argc; i++)
     {
-        // set column index to 0, indicating first column
-        col = 0;
-        //  split the data using comma as the delimiter
-        char *value = strtok(values, ",");
+        if (strcmp(argv[i], "--binary") == 0)
+        {
+            binaryMode = 1;
+        }
+        else if ((strcmp(argv[i], "--from") == 0 || strcmp(argv[i], "--to") == 0) && i + 1 < argc)
+        {
+            double seconds = atof(argv[i + 1]);
+            uint32_t millis = seconds > 0 ? (uint32_t)(seconds * 1000 + 0.5) : 0;
 
-        // store each value into the array
-        while (value != NULL && col < MAX_COLUMNS)
+            if (strcmp(argv[i++], "--from") == 0)
+                from = millis;
+            else
+                to = millis;
+        }
+        else if (strcmp(argv[i], "--png") == 0 && i + 1 < argc)
+        {
+            pngFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+        {
+            batch = argv[++i];
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
         {
-            // printf("row: %d, col: %d, value: %s\n", row, col ,value);
-            if (col < MIDDLE_COL)
+            threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--render") == 0)
+        {
+            render = 1;
+        }
+        else if (strcmp(argv[i], "--scaling") == 0)
+        {
+            scaling = 1;
+        }
+        else if (strcmp(argv[i], "--index") == 0)
+        {
+            int records = buildCaptureIndex("displayPlot.csv");
+            if (records < 0)
             {
-                strcpy(greenData[row][col], value);
+                printf("Error opening file! File does not exist!\n");
+                return 1;
             }
-            else
+            printf("Wrote %d index records to displayPlot.csv%s\n", records, INDEX_SUFFIX);
+            return 0;
+        }
+        else if (strcmp(argv[i], "--bench") == 0)
+        {
+            benchmarkPlot();
+            return 0;
+        }
+        else if (strcmp(argv[i], "--live-socket") == 0)
+        {
+            const char *path = LIVE_SOCKET_PATH;
+
+            // optional path argument after the option
+            if (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0)
             {
-                strcpy(redData[row][col - MIDDLE_COL], value);
+                path = argv[++i];
             }
-            value = strtok(NULL, ",");
-            col++;
+            // remaining options such as --binary still apply
+            for (int j = i + 1; j < argc; j++)
+            {
+                binaryMode |= strcmp(argv[j], "--binary") == 0;
+            }
+            return livePlot(path, binaryMode);
         }
-
-        // move to next row
-        row++;
-
-        // Check if we have reached the maximum number of rows
-        if (row >= MAX_ROWS)
+        else
         {
-            printf("Maximum number of rows reached (%d). Increase MAX_ROWS if needed.\n", MAX_ROWS);
-            break;
+            printf("Unknown option %s\n", argv[i]);
+            return 1;
         }
     }
 
-    // close the CSV file
-    fclose(csvFile);
-    gnuPlot(greenData, redData, row); // calls the function to generate the gnuplot
-    return 0;
-}
-void gnuPlot(char greenData[MAX_ROWS][MIDDLE_COL][LINE_LENGTH], char redData[MAX_ROWS][MIDDLE_COL][LINE_LENGTH], int max_rows)
-{
+    if (batch != NULL)
+    {
+        return runBatch(batch, threads, render, scaling);
+    }
 
-    double greenDataDouble[MAX_ROWS][MIDDLE_COL]; // create a double array to store green data values
-    for (int i = 0; i < max_rows; i++)            // use a nested forloop to loop through the 2D array
+    // read the csv file into the column store
+    initCaptureStore(&store);
+
+    // check if file exists
+    if (loadCaptureRange(&store, "displayPlot.csv", from, to) < 0)
     {
-        for (int j = 0; j < MIDDLE_COL; j++)
-        {
-            greenDataDouble[i][j] = atof(greenData[i][j]); // convert char greenData to double greenData
-        }
+        printf("Error opening file! File does not exist!\n");
+        freeCaptureStore(&store);
+        return 1;
     }
-    double redDataDouble[MAX_ROWS][MIDDLE_COL]; // create a double array to store red data values
-    for (int i = 0; i < max_rows; i++)
+    printf("Loaded %zu samples in %zu runs, %zu bytes\n", store.count, store.runCount, captureStoreBytes(&store));
+
+    // report what the LEDs actually did
+    struct pairStats stats; // measured frequency, duty cycle, jitter and glitches of both LEDs
+    analyseCapture(&store, 0, store.count, &stats);
+    printPairStats(stdout, &stats);
+
+    if (pngFile != NULL)
     {
-        for (int j = 0; j < MIDDLE_COL; j++)
+        struct timespec start, end;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (renderCapturePng(&store, 0, store.count, &stats, pngFile) != 0)
         {
-            redDataDouble[i][j] = atof(redData[i][j]); // convert char redData to double redData
+            printf("Cannot render %s\n", pngFile);
+            freeCaptureStore(&store);
+            return 1;
         }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printf("Rendered %s in %.2f ms\n", pngFile, elapsedSeconds(start, end) * 1000);
     }
+    else
+    {
+        gnuPlot(&store, &stats, binaryMode); // calls the function to generate the gnuplot
+    }
+    freeCaptureStore(&store);
+    return 0;
+}
+void gnuPlot(const struct captureStore *store, const struct pairStats *stats, int binaryMode)
+{
+    if (store->count == 0) // nothing to plot
+    {
+        printf("The capture has no samples\n");
+        return;
+    }
+    const struct captureRun *run = &store->runs[0]; // configuration shown in the titles
 
-    FILE *gnuplotPipe = popen("gnuplot -persistent", "w"); // open pipe to gnuplot
+    FILE *gnuplotPipe = openGnuplotPipe(); // open pipe to gnuplot
 
     if (gnuplotPipe == NULL) // if the pointer points to no value
     {
         perror("Cannot open gnuplot pipe"); // print out gnuplot pipe cannot be open. Check if you installed gnuplot
+        return;
     }
 
+    char source[128]; // the gnuplot data source, either inline text or inline binary records
+    plotSource(source, sizeof(source), (int)store->count, binaryMode);
+
     // set terminal to output file to store waveform plots
     // UNCOMMENT THE LINE BELOW IF YOU WANT TO STORE WAVEFORM PLOT
     // fprintf(gnuplotPipe, "set terminal png; set output \'waveform.png\'\n");
@@ -126,7 +249,8 @@ void gnuPlot(char greenData[MAX_ROWS][MIDDLE_COL][LINE_LENGTH], char redData[MAX
     // send commands for first plot
     fprintf(gnuplotPipe, "set multiplot layout 2, 1\n");                                                                               // create a multiplot
     fprintf(gnuplotPipe, "unset key\n");                                                                                               // undo the unset key
-    fprintf(gnuplotPipe, "set title 'Blink Green LED at %.0f Hz, %.0f%% duty cycle'\n", greenDataDouble[0][1], greenDataDouble[0][2]); // set the title of the first graph
+    fprintf(gnuplotPipe, "set title 'Blink Green LED at %.0f Hz, %.0f%% duty cycle (measured %.2f Hz, %.1f%%)'\n",
+            (double)run->greenFrequency, run->greenDutyCycle, measuredFrequency(&stats->green), measuredDutyCycle(&stats->green));      // set the title of the first graph
     fprintf(gnuplotPipe, "set border 2\n");                                                                                            // remove the top and bottom border of the graph
     fprintf(gnuplotPipe, "set tmargin at screen 0.85\n");                                                                              // adjust the top margin of the graph
     fprintf(gnuplotPipe, "set bmargin at screen 0.45\n");                                                                              // adjust the bottom margin of the graph
@@ -135,32 +259,444 @@ void gnuPlot(char greenData[MAX_ROWS][MIDDLE_COL][LINE_LENGTH], char redData[MAX
     fprintf(gnuplotPipe, "unset xtics\n");                                                                                             // remove the xtics from first graph as we will be using from the second graph
     fprintf(gnuplotPipe, "set key title 'waveform'\n");                                                                                // add in title for the legend
     fprintf(gnuplotPipe, "set ytics 0,1\n");                                                                                           // set the ytics to only show 0 and 1 instead of decimals
-    fprintf(gnuplotPipe, "plot '-' with steps linecolor '#009933'\n");                                                                 // plot out the graph with the color being green in step line
+    fprintf(gnuplotPipe, "plot %s with steps linecolor '#009933'\n", source);                                                         // plot out the graph with the color being green in step line
 
-    for (int i = 0; i < max_rows; i++) // loop through the green array
-    {
-        fprintf(gnuplotPipe, "%f %f\n", greenDataDouble[i][0], greenDataDouble[i][3]); // let x axis be greenDataDouble[i][0] (time iteration), and y axis to be greenDataDouble[i][3](state of green LED)
-    }
-    fprintf(gnuplotPipe, "e\n"); // to end data input
+    // let x axis be the time column, and y axis to be the state of green LED
+    sendStateColumn(gnuplotPipe, store, store->greenState, 0, store->count, binaryMode);
     // End of first plot
 
     // send commands for second plot
-    fprintf(gnuplotPipe, "set title 'Blink Red LED at %.0f Hz, %.0f%% duty cycle'\n", redDataDouble[0][1], redDataDouble[0][2]); // set the title of the second graph
+    fprintf(gnuplotPipe, "set title 'Blink Red LED at %.0f Hz, %.0f%% duty cycle (measured %.2f Hz, %.1f%%)'\n",
+            (double)run->redFrequency, run->redDutyCycle, measuredFrequency(&stats->red), measuredDutyCycle(&stats->red)); // set the title of the second graph
     fprintf(gnuplotPipe, "set border 3\n");                                                                                      // remove the top border of the graph
     fprintf(gnuplotPipe, "set bmargin at screen 0.1\n");                                                                         // adjust bottom margin of the graph
     fprintf(gnuplotPipe, "set tmargin at screen 0.45\n");                                                                        // adjust the top margin of the graph
     fprintf(gnuplotPipe, "set yrange [-0.5:1.5]\n");                                                                             // set the range of y to be from -0.5 to 1.5 to accomodate the actual data
     fprintf(gnuplotPipe, "set xtics auto\n");                                                                                    // auto adjust the x tics for x axis
     fprintf(gnuplotPipe, "set tics nomirror\n");                                                                                 // remove the tics on top and right hand side
-    fprintf(gnuplotPipe, "plot '-' with steps linecolor 'red'\n");                                                               // plot out the graph with the color being red in step line
+    fprintf(gnuplotPipe, "plot %s with steps linecolor 'red'\n", source);                                                       // plot out the graph with the color being red in step line
 
-    for (int i = 0; i < max_rows; i++) // loop through both green and red array
-    {
-        fprintf(gnuplotPipe, "%lf %f\n", greenDataDouble[i][0], redDataDouble[i][3]); // let x axis be greenDataDouble[i][0] (time iteration), and y axis to be redDataDouble[i][3](state of green LED)
-    }
-    fprintf(gnuplotPipe, "e\n"); // to end data input
+    // let x axis be the time column, and y axis to be the state of red LED
+    sendStateColumn(gnuplotPipe, store, store->redState, 0, store->count, binaryMode);
     // End of the second plot
 
     // close the pipe
-    fclose(gnuplotPipe);
-}
\ No newline at end of file
+    pclose(gnuplotPipe);
+}
+
+/*
+Opens the pipe to gnuplot with a large stdio buffer so that the data is written in big blocks
+*/
+FILE *openGnuplotPipe()
+{
+    FILE *gnuplotPipe = popen("gnuplot -persistent", "w");
+
+    if (gnuplotPipe != NULL)
+    {
+        setvbuf(gnuplotPipe, NULL, _IOFBF, PIPE_BUFFER_SIZE);
+    }
+    return gnuplotPipe;
+}
+
+/*
+Builds the data source for a plot command.
+Text mode reads "x y" lines up to an 'e' line, binary mode reads count records of two float64 values
+*/
+void plotSource(char *source, size_t size, int count, int binaryMode)
+{
+    if (binaryMode)
+    {
+        snprintf(source, size, "'-' binary record=(%d) format='%%float64%%float64' using 1:2", count);
+    }
+    else
+    {
+        snprintf(source, size, "'-'");
+    }
+}
+
+static double chunk[BINARY_CHUNK * 2]; // interleaved x, y pairs waiting to be written in binary mode
+static int chunkUsed = 0;              // pairs in the chunk
+
+/*
+Sends one point to gnuplot. In binary mode the point is packed into a chunk buffer and
+the chunk is written with one fwrite when it is full, so gnuplot does not have to parse any numbers.
+*/
+void sendPoint(FILE *gnuplotPipe, double x, double y, int binaryMode)
+{
+    if (!binaryMode)
+    {
+        fprintf(gnuplotPipe, "%f %f\n", x, y);
+        return;
+    }
+
+    chunk[chunkUsed * 2] = x;
+    chunk[chunkUsed * 2 + 1] = y;
+    if (++chunkUsed == BINARY_CHUNK)
+    {
+        fwrite(chunk, sizeof(double) * 2, chunkUsed, gnuplotPipe);
+        chunkUsed = 0;
+    }
+}
+
+/*
+Ends the data of one plot. Binary records have a fixed count, so binary mode only flushes the chunk
+*/
+void endPlotData(FILE *gnuplotPipe, int binaryMode)
+{
+    if (!binaryMode)
+    {
+        fprintf(gnuplotPipe, "e\n"); // to end data input
+        return;
+    }
+    if (chunkUsed > 0)
+    {
+        fwrite(chunk, sizeof(double) * 2, chunkUsed, gnuplotPipe);
+        chunkUsed = 0;
+    }
+}
+
+/*
+Sends count (x, y) points to gnuplot.
+x and y point to the first value of each column and stride is the distance between two rows (in doubles).
+*/
+void sendPlotData(FILE *gnuplotPipe, const double *x, const double *y, int stride, int count, int binaryMode)
+{
+    for (int i = 0; i < count; i++)
+    {
+        sendPoint(gnuplotPipe, x[i * stride], y[i * stride], binaryMode);
+    }
+    endPlotData(gnuplotPipe, binaryMode);
+}
+
+/*
+Sends count samples starting at first from the time column and a bit-packed state column of the store
+*/
+void sendStateColumn(FILE *gnuplotPipe, const struct captureStore *store, const uint64_t *state, size_t first, size_t count, int binaryMode)
+{
+    for (size_t i = first; i < first + count; i++)
+    {
+        sendPoint(gnuplotPipe, store->time[i], sampleState(state, i), binaryMode);
+    }
+    endPlotData(gnuplotPipe, binaryMode);
+}
+
+/*
+Returns the number of seconds between two timestamps
+*/
+double elapsedSeconds(struct timespec start, struct timespec end)
+{
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/*
+Measures the time-to-first-plot of the text and binary paths for 10^4 to 10^7 points.
+A synthetic 5 Hz, 50% duty cycle square wave sampled every 10 ms is plotted to gnuplot's 'unknown' terminal,
+and the time is taken from opening the pipe until gnuplot has finished drawing and exited.
+*/
+void benchmarkPlot()
+{
+    printf("%10s %12s %12s %8s\n", "points", "text (s)", "binary (s)", "speedup");
+
+    for (int points = BENCH_MIN_POINTS; points <= BENCH_MAX_POINTS; points *= 10)
+    {
+        double *x = malloc(points * sizeof(double));
+        double *y = malloc(points * sizeof(double));
+
+        if (x == NULL || y == NULL)
+        {
+            fprintf(stderr, "Memory allocation failed");
+            free(x);
+            free(y);
+            return;
+        }
+
+        for (int i = 0; i < points; i++)
+        {
+            x[i] = i * 10.0;
+            y[i] = (i / 10) % 2; // 100 ms on, 100 ms off
+        }
+
+        double seconds[2];
+        for (int binaryMode = 0; binaryMode <= 1; binaryMode++)
+        {
+            struct timespec start, end;
+            char source[128];
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            FILE *gnuplotPipe = popen("gnuplot", "w");
+            if (gnuplotPipe == NULL)
+            {
+                perror("Cannot open gnuplot pipe");
+                free(x);
+                free(y);
+                return;
+            }
+            setvbuf(gnuplotPipe, NULL, _IOFBF, PIPE_BUFFER_SIZE);
+
+            plotSource(source, sizeof(source), points, binaryMode);
+            fprintf(gnuplotPipe, "set terminal unknown\n");
+            fprintf(gnuplotPipe, "plot %s with steps\n", source);
+            sendPlotData(gnuplotPipe, x, y, 1, points, binaryMode);
+            pclose(gnuplotPipe); // waits for gnuplot to finish the plot
+            clock_gettime(CLOCK_MONOTONIC, &end);
+
+            seconds[binaryMode] = elapsedSeconds(start, end);
+        }
+
+        printf("%10d %12.3f %12.3f %7.1fx\n", points, seconds[0], seconds[1], seconds[0] / seconds[1]);
+        free(x);
+        free(y);
+    }
+}
+
+/*
+Returns a monotonic timestamp in milliseconds
+*/
+long monotonicMillis()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000L + now.tv_nsec / 1000000L;
+}
+
+void resetLiveWindow(struct liveWindow *window)
+{
+    window->head = 0;
+    window->count = 0;
+    window->dirty = 1;
+    window->samples = 0;
+    window->pendingLength = 0;
+    initPairStats(&window->stats, 0, 0, 0, 0);
+}
+
+/*
+Parses one CSV row of a live capture into the ring buffer. The header row and incomplete rows are skipped.
+*/
+void parseLiveLine(struct liveWindow *window, char *line)
+{
+    double values[CAPTURE_COLUMNS];
+
+    if (!parseCaptureRow(line, values))
+    {
+        return; // header row, empty line or incomplete row
+    }
+
+    // the configured frequency and duty cycle are taken from the first row
+    if (window->samples++ == 0)
+    {
+        initPairStats(&window->stats, (int)values[COL_FREQUENCY], values[COL_DUTY],
+                      (int)values[RED_COLUMN + COL_FREQUENCY], values[RED_COLUMN + COL_DUTY]);
+    }
+    updatePairStats(&window->stats, values[COL_TIME], (int)values[COL_STATE], (int)values[RED_COLUMN + COL_STATE]);
+
+    window->time[window->head] = values[COL_TIME];
+    window->green[window->head] = values[COL_STATE];
+    window->red[window->head] = values[RED_COLUMN + COL_STATE];
+    window->head = (window->head + 1) % LIVE_WINDOW;
+    if (window->count < LIVE_WINDOW)
+    {
+        window->count++;
+    }
+    window->dirty = 1;
+}
+
+/*
+Splits newly received bytes into lines. Only the new bytes are looked at, so the cost does not grow with the capture length.
+*/
+void consumeLiveData(struct liveWindow *window, const char *data, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        if (data[i] == '\n' || data[i] == '\r')
+        {
+            window->pending[window->pendingLength] = '\0';
+            parseLiveLine(window, window->pending);
+            window->pendingLength = 0;
+        }
+        else if (window->pendingLength < LINE_LENGTH - 1)
+        {
+            window->pending[window->pendingLength++] = data[i];
+        }
+    }
+}
+
+/*
+Redraws both panels from the samples in the window. The amount of data sent is bounded by LIVE_WINDOW.
+*/
+void refreshLivePlot(FILE *gnuplotPipe, struct liveWindow *window, int binaryMode)
+{
+    static double time[LIVE_WINDOW], green[LIVE_WINDOW], red[LIVE_WINDOW]; // window in time order
+    char source[128];
+    int first = (window->head - window->count + LIVE_WINDOW) % LIVE_WINDOW;
+
+    for (int i = 0; i < window->count; i++)
+    {
+        int slot = (first + i) % LIVE_WINDOW;
+        time[i] = window->time[slot];
+        green[i] = window->green[slot];
+        red[i] = window->red[slot];
+    }
+    window->dirty = 0;
+
+    if (window->count == 0)
+    {
+        return;
+    }
+    plotSource(source, sizeof(source), window->count, binaryMode);
+
+    fprintf(gnuplotPipe, "set multiplot layout 2, 1\n");
+    fprintf(gnuplotPipe, "unset key\n");
+    fprintf(gnuplotPipe, "set xrange [%f:%f]\n", time[0], time[window->count - 1] > time[0] ? time[window->count - 1] : time[0] + 1);
+    fprintf(gnuplotPipe, "set yrange [-0.5:1.5]\n");
+    fprintf(gnuplotPipe, "set ytics 0,1\n");
+    fprintf(gnuplotPipe, "set tics nomirror\n");
+
+    fprintf(gnuplotPipe, "set title 'Live Green LED (measured %.2f Hz, %.1f%%)'\n", measuredFrequency(&window->stats.green), measuredDutyCycle(&window->stats.green));
+    fprintf(gnuplotPipe, "set border 2\n");
+    fprintf(gnuplotPipe, "set tmargin at screen 0.85\n");
+    fprintf(gnuplotPipe, "set bmargin at screen 0.45\n");
+    fprintf(gnuplotPipe, "unset xtics\n");
+    fprintf(gnuplotPipe, "plot %s with steps linecolor '#009933'\n", source);
+    sendPlotData(gnuplotPipe, time, green, 1, window->count, binaryMode);
+
+    fprintf(gnuplotPipe, "set title 'Live Red LED (measured %.2f Hz, %.1f%%)'\n", measuredFrequency(&window->stats.red), measuredDutyCycle(&window->stats.red));
+    fprintf(gnuplotPipe, "set border 3\n");
+    fprintf(gnuplotPipe, "set bmargin at screen 0.1\n");
+    fprintf(gnuplotPipe, "set tmargin at screen 0.45\n");
+    fprintf(gnuplotPipe, "set xtics auto\n");
+    fprintf(gnuplotPipe, "plot %s with steps linecolor 'red'\n", source);
+    sendPlotData(gnuplotPipe, time, red, 1, window->count, binaryMode);
+
+    fprintf(gnuplotPipe, "unset multiplot\n");
+    fflush(gnuplotPipe);
+}
+
+/*
+Creates the Unix socket the recorder connects to. It is a SOCK_SEQPACKET socket, so every row arrives
+as one whole message: a row the recorder cannot send without blocking is dropped whole instead of
+being cut in half. Returns the listening descriptor, or -1 on error.
+*/
+int openLiveSocket(const char *socketPath)
+{
+    struct sockaddr_un address;
+    int listenFd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+
+    if (listenFd < 0)
+    {
+        return -1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+    unlink(socketPath); // remove a stale socket from an earlier run
+
+    if (bind(listenFd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(listenFd, 1) < 0)
+    {
+        close(listenFd);
+        return -1;
+    }
+    return listenFd;
+}
+
+void stopLivePlot(int signalNumber)
+{
+    (void)signalNumber;
+    liveStopped = 1;
+}
+
+/*
+Live mode: reads rows from the recorder's Unix socket and redraws a scrolling window of the latest
+LIVE_WINDOW samples every LIVE_REFRESH_MS until Ctrl+C.
+*/
+int livePlot(const char *socketPath, int binaryMode)
+{
+    static struct liveWindow window; // too large for the stack
+    int clientFd = -1;
+    char buffer[65536];
+
+    resetLiveWindow(&window);
+    signal(SIGINT, stopLivePlot);
+
+    FILE *gnuplotPipe = openGnuplotPipe();
+    if (gnuplotPipe == NULL)
+    {
+        perror("Cannot open gnuplot pipe");
+        return 1;
+    }
+
+    int listenFd = openLiveSocket(socketPath);
+    if (listenFd < 0)
+    {
+        perror("Cannot open live socket");
+        pclose(gnuplotPipe);
+        return 1;
+    }
+    printf("Waiting for samples on %s, press Ctrl+C to stop\n", socketPath);
+
+    long nextRefresh = monotonicMillis() + LIVE_REFRESH_MS;
+
+    while (!liveStopped)
+    {
+        struct pollfd fds[1];
+        long timeout = nextRefresh - monotonicMillis();
+
+        fds[0].fd = clientFd >= 0 ? clientFd : listenFd;
+        fds[0].events = POLLIN;
+
+        if (poll(fds, 1, timeout > 0 ? timeout : 0) < 0 && errno != EINTR)
+        {
+            perror("poll");
+            break;
+        }
+
+        if (fds[0].revents & (POLLIN | POLLHUP))
+        {
+            if (clientFd < 0)
+            {
+                clientFd = accept(listenFd, NULL, NULL);
+                resetLiveWindow(&window); // every recorder connection is a new capture
+            }
+            else
+            {
+                ssize_t length = read(clientFd, buffer, sizeof(buffer));
+                if (length > 0)
+                {
+                    consumeLiveData(&window, buffer, length);
+                }
+                else
+                {
+                    consumeLiveData(&window, "\n", 1); // recorder finished, flush the last row
+                    close(clientFd);
+                    clientFd = -1;
+                }
+            }
+        }
+
+        long now = monotonicMillis();
+        if (now >= nextRefresh)
+        {
+            if (window.dirty)
+            {
+                refreshLivePlot(gnuplotPipe, &window, binaryMode);
+            }
+            nextRefresh += LIVE_REFRESH_MS;
+            if (nextRefresh <= now)
+            {
+                nextRefresh = now + LIVE_REFRESH_MS; // skip refreshes that were missed instead of catching up
+            }
+        }
+    }
+
+    // clean up
+    printf("\n");
+    printPairStats(stdout, &window.stats);
+    if (clientFd >= 0)
+    {
+        close(clientFd);
+    }
+    close(listenFd);
+    unlink(socketPath);
+    pclose(gnuplotPipe);
+    return 0;
+}
@@ -1,13 +1,30 @@
 /*
 === HOW TO RUN ===
 Step 1: cd into C file location
-Step 2: gcc -o newStudent newStudent.c -lwiringPi
-Step 3: rm -rf displayPlot.csv
+Step 2: gcc -o newStudent newStudent.c captureStore.c pwmEngine.c telemetry.c waveAnalyser.c -lwiringPi -lm -pthread
+Step 3: rm -rf displayPlot.csv displayPlot.csv.idx
 Step 3: ./newStudent
 
+=== SWEEPS ===
+Runs a matrix of frequency/duty cycle captures without the menus, each into its own file in --out:
+./newStudent --freq 1,2,5,10 --duty 10,50,90 --duration 5 --leds green --out sweep
+--leds both blinks both LEDs with the same configuration, --concurrent runs two configurations
+at once, one on the green and one on the red LED. The same keys can be put in a file as
+"freq = 1,2,5" lines and passed with --config sweep.conf (command line options after it override it).
+
 === PRE-REQUISITES ===
 Install wiringPi: https://learn.sparkfun.com/tutorials/raspberry-gpio/c-wiringpi-setup
-softPwm is installed with wiringPi
+PWM is driven by pwmEngine.c, one thread for all LEDs instead of one softPwm thread per pin.
+The LED pins belong to the engine, they are only switched through pwmEngineWrite.
+
+=== LIVE PLOT ===
+Run ./displayPlot --live-socket on the Pi (or with the socket forwarded) before blinking,
+every recorded sample is then streamed to it while the capture is running.
+
+=== TELEMETRY ===
+Loop rate, sample lateness and buffer use of the recorder, and GPIO call time, period lateness and
+late periods of the PWM engine thread (thread="record" and thread="pwm") are written once per second
+to /tmp/ledRecorder.prom (Prometheus text format), e.g. watch cat /tmp/ledRecorder.prom
 
 === USEFUL COMMANDS ===
 Check wiringPi version: gpio -v
@@ -29,13 +46,19 @@ VERSION_CODENAME=buster
 */
 
 #include <wiringPi.h>
-#include <softPwm.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <wiringSerial.h>
 #include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "captureStore.h"
+#include "pwmEngine.h"
+#include "telemetry.h"
+#include "waveAnalyser.h"
 
 /* DEFINITIONS */
 #define RED 27   // GPIO Pin 27
@@ -55,10 +78,29 @@ VERSION_CODENAME=buster
 // Defining Millisecond
 #define TO_MILLIS 1000
 
+// PWM engine: 100 steps of 100us = 100Hz, the same as softPwm
+#define PWM_RANGE 100
+#define PWM_TICK_MICROS 100
+#define PWM_USE_HARDWARE 0 // set to 1 to drive GPIO13 from its hardware PWM channel
+#define PWM_BASE_CLOCK_MHZ 19.2
+
 // Define Confirmation Status for how many led to blink
 #define oneLed 45
 #define twoLed 30
 
+// Live plot socket, must match LIVE_SOCKET_PATH in displayPlot.c
+#define LIVE_SOCKET_PATH "/tmp/displayPlot.sock"
+
+// Recorder buffer: one sample every 10ms for 1 minute
+#define SAMPLE_PERIOD_MICROS (10 * TO_MILLIS)
+#define SAMPLE_CAPACITY 6000
+
+// Sweep runner defaults
+#define SWEEP_MAX_VALUES 32      // values in one --freq or --duty list
+#define SWEEP_DEFAULT_SECONDS 5  // recording time of one sweep run
+#define SWEEP_DEFAULT_DIR "sweep"
+#define SWEEP_BOTH 3             // --leds both, next to BLINK_GREEN and BLINK_RED
+
 // MONITORING
 // #define STUDENTID "2101234" // the student ID is not needed in the group project of 2023
 
@@ -80,7 +122,15 @@ void updateLED();
 void storeDataIntoMemory();
 void writeDataIntoCSV();
 int checkFileExist(const char *fileName);
+int openLiveFeed();
+void sendLiveSample();
+int writeCaptureFile();
+int parseSweepArgs();
+int runSweep();
+int recordChannels();
 void endProgram();
+void setupHardwarePwm(int, int, int);
+void printPwmDutyCycle();
 
 /* This creates a structure(object)*/
 struct CSV
@@ -100,9 +150,52 @@ struct ledData
     unsigned long previousMillis;
 };
 
+/* One configuration of a sweep, see runSweep */
+struct sweepConfig
+{
+    int frequencies[SWEEP_MAX_VALUES];
+    int frequencyCount;
+    float dutyCycles[SWEEP_MAX_VALUES];
+    int dutyCount;
+    int leds;       // BLINK_GREEN, BLINK_RED or SWEEP_BOTH
+    int concurrent; // run two configurations at once on the green and red LED
+    int seconds;    // recording time per run
+    char outDir[128];
+};
+
+/* One LED recorded by recordChannels */
+struct sweepChannel
+{
+    struct ledData led;
+    struct CSV *samples;
+};
+
+/* Menus clear the screen, a scripted sweep keeps its output */
+static int interactive = 1;
+
+/* Counters of the record loop, one set per thread so updating them needs no locking */
+static _Thread_local struct telemetry recorderTelemetry;
+
+/* GPIO access for the PWM engine */
+const struct pwmBackend wiringPiPwmBackend = {digitalWrite, digitalRead, setupHardwarePwm, pwmWrite, NULL};
+
 /* MAIN PROGRAM */
-int main(void)
+int main(int argc, char *argv[])
 {
+    if (argc > 1)
+    {
+        struct sweepConfig config;
+
+        if (parseSweepArgs(argc, argv, &config) != 0)
+        {
+            return 1;
+        }
+        interactive = 0;
+        setupProgram();
+        int result = runSweep(&config);
+        endProgram();
+        return result;
+    }
 
     setupProgram();
     startProgram();
@@ -118,9 +211,37 @@ void setupProgram()
     wiringPiSetupGpio();
     pinMode(RED, OUTPUT);
     pinMode(GREEN, OUTPUT);
-    softPwmCreate(GREEN, 0, 100);
-    softPwmCreate(RED, 0, 100);
-    system("clear");
+    pwmEngineStart(&wiringPiPwmBackend, PWM_RANGE, PWM_TICK_MICROS, PWM_USE_HARDWARE);
+    pwmEngineAddChannel(GREEN);
+    pwmEngineAddChannel(RED);
+    if (interactive)
+        system("clear");
+}
+
+/*
+Hands a pin to the hardware PWM channel with the same range and period as the software channels
+*/
+void setupHardwarePwm(int pin, int range, int tickMicros)
+{
+    pinMode(pin, PWM_OUTPUT);
+    pwmSetMode(PWM_MODE_MS);
+    pwmSetRange(range);
+    pwmSetClock((int)(PWM_BASE_CLOCK_MHZ * tickMicros));
+}
+
+/*
+Prints how much of the time the PWM engine actually drove each LED during the last recording,
+and the engine thread's telemetry since the program started
+*/
+void printPwmDutyCycle()
+{
+    struct telemetry engine;
+
+    printf("PWM output: Green %.2f%%, Red %.2f%% (%lu late periods)\n", pwmEngineDutyCycle(GREEN), pwmEngineDutyCycle(RED), pwmEngineLatePeriods());
+    if (telemetryPublished(PWM_ENGINE_THREAD, &engine) == 0)
+    {
+        printTelemetry(stdout, &engine);
+    }
 }
 
 /*
@@ -196,10 +317,8 @@ void turnOffLeds()
 {
     system("clear");
     printf("\nTurning off both LEDs...\n");
-    digitalWrite(GREEN, LOW);
-    softPwmWrite(GREEN, 0);
-    digitalWrite(RED, LOW);
-    softPwmWrite(RED, 0);
+    pwmEngineWrite(GREEN, 0);
+    pwmEngineWrite(RED, 0);
 }
 
 /*
@@ -209,10 +328,8 @@ void turnOnLeds()
 {
     system("clear");
     printf("\nTurning on both LEDs...\n");
-    digitalWrite(GREEN, HIGH);
-    softPwmWrite(GREEN, 100);
-    digitalWrite(RED, HIGH);
-    softPwmWrite(RED, 100);
+    pwmEngineWrite(GREEN, PWM_RANGE);
+    pwmEngineWrite(RED, PWM_RANGE);
 }
 
 /*
@@ -436,50 +553,28 @@ void recordBothWaveFormIntoData(int blinkLed, int blinkFrequency, float blinkBri
         return;
     }
 
-    /*Initializing Variables to do while loop for 1 minute*/
-    unsigned long currentMillis = millis();
-    unsigned long nextRecord = currentMillis;
-    unsigned long minuteMillis = currentMillis + (60 * TO_MILLIS);
-    int iterations = 0;
-    int timeLapse = 0;
+    struct pairStats stats; /* measured behaviour of both LEDs, analysed while recording */
+    struct sweepChannel channels[2] = {{greenData, malloc(SAMPLE_CAPACITY * sizeof(struct CSV))},
+                                       {redData, malloc(SAMPLE_CAPACITY * sizeof(struct CSV))}};
 
-    struct CSV *redDataArr = malloc(6000 * sizeof(struct CSV));
-    struct CSV *greenDataArr = malloc(6000 * sizeof(struct CSV));
-
-    if (redDataArr == NULL || greenDataArr == NULL)
+    if (channels[0].samples == NULL || channels[1].samples == NULL)
     {
         fprintf(stderr, "Memory allocation failed");
+        free(channels[0].samples);
+        free(channels[1].samples);
         return;
     }
 
-    /*Make LED blink based on duty cycle and record wave form data into CSV*/
-    do
-    {
-        currentMillis = millis();
-        updateLED(&redData, currentMillis);
-        updateLED(&greenData, currentMillis);
-        /* Write data into array based on 10ms period*/
-        if (currentMillis >= nextRecord)
-        {
-            storeDataIntoMemory(redDataArr, &redData, timeLapse, iterations);
-            storeDataIntoMemory(greenDataArr, &greenData, timeLapse, iterations);
-            iterations++;
-            nextRecord = currentMillis + (10);
-            timeLapse += 10;
-        }
-        /* Once it reaches 6000 break the while stateemnt*/
-        if (iterations >= 6000)
-        {
-            break;
-        }
+    /*Make LED blink based on duty cycle and record wave form data into CSV for 1 minute*/
+    int iterations = recordChannels(channels, 2, 60 * TO_MILLIS, SAMPLE_CAPACITY, &stats);
 
-    } while (currentMillis < minuteMillis);
     /*To free up memory spaces for the structure arrays and write data information into LED*/
-    softPwmWrite(GREEN, 0);
-    softPwmWrite(RED, 0);
-    writeDataIntoCSV(redDataArr, greenDataArr, iterations, blinkLed);
-    free(greenDataArr);
-    free(redDataArr);
+    printPairStats(stdout, &stats);
+    printPwmDutyCycle();
+    printTelemetry(stdout, &recorderTelemetry);
+    writeDataIntoCSV(channels[1].samples, channels[0].samples, iterations, blinkLed);
+    free(channels[0].samples);
+    free(channels[1].samples);
     /* Reset the static array to store empty values if the users want to try other LED duty cycle for both LED*/
     redData.blinkLed = 0;
     greenData.blinkLed = 0;
@@ -492,50 +587,24 @@ void recordWaveDataIntoMemory(int blinkLed, int blinkFrequency, float blinkBrigh
     printf("\nBlinking...\n");
     /* Formulas and initializer*/
     int color = blinkLed == BLINK_GREEN ? GREEN : RED;
-    struct ledData dataStruct = (struct ledData){color, blinkFrequency, blinkBrightness, LOW, 0};
-    struct CSV *data;
-    data = malloc(6000 * sizeof(struct CSV));
+    struct sweepChannel channel = {{color, blinkFrequency, blinkBrightness, LOW, 0}, malloc(SAMPLE_CAPACITY * sizeof(struct CSV))};
+    struct pairStats stats; /* measured behaviour of the LED, analysed while recording */
 
-    if (data == NULL)
+    if (channel.samples == NULL)
     {
         fprintf(stderr, "Memory allocation failed");
         return;
     }
 
-    /* Intializes the Millisecond counter to compare insert data into memory*/
-    unsigned long currentMillis = millis();
-    unsigned long nextRecord = currentMillis;
-    unsigned long testData = currentMillis + (60 * TO_MILLIS);
-    int iterations = 0;
-    int timeLapse = 0;
-
-    do
-    {
-        currentMillis = millis();
-
-        updateLED(&dataStruct, currentMillis);
+    /* Blinks and stores a record every 10millisecond for 1 minute, the LED that is not blinking is streamed as off */
+    int iterations = recordChannels(&channel, 1, 60 * TO_MILLIS, SAMPLE_CAPACITY, &stats);
 
-        /* Stores record every 10millisecond */
-        if (currentMillis >= nextRecord)
-        {
-            storeDataIntoMemory(data, &dataStruct, timeLapse, iterations);
-            iterations++;
-            nextRecord = currentMillis + (10);
-            timeLapse += 10;
-        }
-
-        /*If the iteration reaches 6k, will break the function and continue on*/
-        if (iterations == 6000)
-        {
-            break;
-        }
-
-    } while (currentMillis < testData);
-
-    /*ensures that the current color will be off after looping and write data into csv and make sure the memory allocation is freed after use*/
-    softPwmWrite(color, 0);
-    writeDataIntoCSV(data, NULL, iterations, blinkLed);
-    free(data);
+    /*write data into csv and make sure the memory allocation is freed after use*/
+    printWaveStats(stdout, color == GREEN ? "Green" : "Red", color == GREEN ? &stats.green : &stats.red);
+    printPwmDutyCycle();
+    printTelemetry(stdout, &recorderTelemetry);
+    writeDataIntoCSV(channel.samples, NULL, iterations, blinkLed);
+    free(channel.samples);
 }
 
 void storeDataIntoMemory(struct CSV *data, struct ledData *LEDdata, int timeLapse, int iterations)
@@ -544,7 +613,8 @@ void storeDataIntoMemory(struct CSV *data, struct ledData *LEDdata, int timeLaps
     data[iterations].timeIterations = timeLapse;
     data[iterations].frequency = LEDdata->blinkFrequency;
     data[iterations].dutyCycle = LEDdata->blinkBrightness;
-    data[iterations].state = digitalRead(LEDdata->blinkLed);
+    /* the pin carries the PWM carrier, so the state is the level the engine read back while the carrier was high */
+    data[iterations].state = pwmEngineState(LEDdata->blinkLed);
 }
 
 void updateLED(struct ledData *ledData, unsigned long currentMillis)
@@ -559,9 +629,9 @@ void updateLED(struct ledData *ledData, unsigned long currentMillis)
         ledData->previousMillis = currentMillis;
     }
 
+    /* the engine owns the pin, writing it directly would cut the PWM pulses short */
     int brightness = ledData->ledState == HIGH ? ledData->blinkBrightness : 0;
-    softPwmWrite(ledData->blinkLed, brightness);
-    digitalWrite(ledData->blinkLed, ledData->ledState);
+    pwmEngineWrite(ledData->blinkLed, brightness);
 }
 
 /*
@@ -612,26 +682,59 @@ void writeDataIntoCSV(struct CSV *data, struct CSV *secondData, int sizeArr, int
     /*Checks whether file is empty based on data integerity*/
     if (checkFileExist("displayPlot.csv") == 0)
     {
-        /*Creating a new csv to store the data in and header*/
-        FILE *CSV = fopen("displayPlot.csv", "wb+");
-        fprintf(CSV, "Green Iterations,Green Frequency,Green Duty Cycle,Green State,Red Iterations,Red Frequency, Red Duty Cycle,Red State"); // Creating Header for the file
-
-        for (int i = 0; i < sizeArr; i++)
+        /*Creating a new csv to store the data in and inform the user*/
+        if (writeCaptureFile("displayPlot.csv", greenLedArray, redLedArray, sizeArr) == 0)
         {
-            fprintf(CSV,
-                    "\n%d,%d,%.2f,%d,%d,%d,%.2f,%d",
-                    greenLedArray[i].timeIterations, greenLedArray[i].frequency, greenLedArray[i].dutyCycle, greenLedArray[i].state,
-                    redLedArray[i].timeIterations, redLedArray[i].frequency, redLedArray[i].dutyCycle, redLedArray[i].state);
+            printf("New CSV file displayPlot has been created");
         }
-
-        /* Informs user CSV has been created and close the file editor*/
-        printf("New CSV file displayPlot has been created");
-        fclose(CSV);
     }
     memset(redLedArray, 0, sizeArr);
     memset(greenLedArray, 0, sizeArr);
 }
 
+/*
+Writes a capture and its sparse time index (<fileName>.idx, so displayPlot can seek to --from).
+A NULL green or red array is written as an LED that stays off. Returns 0 on success, -1 on error.
+*/
+int writeCaptureFile(const char *fileName, struct CSV *green, struct CSV *red, int sizeArr)
+{
+    char indexName[256];
+    struct CSV off = {0};
+    FILE *CSV = fopen(fileName, "wb+");
+
+    if (CSV == NULL)
+    {
+        perror(fileName);
+        return -1;
+    }
+    snprintf(indexName, sizeof(indexName), "%s%s", fileName, INDEX_SUFFIX);
+    FILE *index = fopen(indexName, "w");
+    fprintf(CSV, "Green Iterations,Green Frequency,Green Duty Cycle,Green State,Red Iterations,Red Frequency, Red Duty Cycle,Red State"); // Creating Header for the file
+
+    for (int i = 0; i < sizeArr; i++)
+    {
+        struct CSV *g = green ? &green[i] : &off;
+        struct CSV *r = red ? &red[i] : &off;
+
+        off.timeIterations = green ? green[i].timeIterations : red[i].timeIterations;
+        if (index != NULL && i % INDEX_INTERVAL == 0)
+        {
+            writeIndexRecord(index, g->timeIterations, ftell(CSV));
+        }
+        fprintf(CSV,
+                "\n%d,%d,%.2f,%d,%d,%d,%.2f,%d",
+                g->timeIterations, g->frequency, g->dutyCycle, g->state,
+                r->timeIterations, r->frequency, r->dutyCycle, r->state);
+    }
+
+    fclose(CSV);
+    if (index != NULL)
+    {
+        fclose(index);
+    }
+    return 0;
+}
+
 /*
 This helps to check whether the file exists
 */
@@ -647,20 +750,448 @@ int checkFileExist(const char *fileName)
     return 0;
 }
 
+/*
+Connects to the live plot socket of displayPlot --live-socket (SOCK_SEQPACKET, one message per row).
+Returns the socket, or -1 if no live plot is running (recording then works as before).
+*/
+int openLiveFeed()
+{
+    struct sockaddr_un address;
+    int liveFeed = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+
+    if (liveFeed < 0)
+    {
+        return -1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, LIVE_SOCKET_PATH, sizeof(address.sun_path) - 1);
+
+    if (connect(liveFeed, (struct sockaddr *)&address, sizeof(address)) < 0)
+    {
+        close(liveFeed);
+        return -1;
+    }
+    return liveFeed;
+}
+
+/*
+Streams one sample to the live plot in the same row format as displayPlot.csv.
+The send never blocks, if the plot falls behind the whole row is dropped so the blink timing is not disturbed.
+*/
+void sendLiveSample(int liveFeed, struct CSV *green, struct CSV *red)
+{
+    char row[128];
+
+    if (liveFeed < 0)
+    {
+        return;
+    }
+
+    int length = snprintf(row, sizeof(row), "%d,%d,%.2f,%d,%d,%d,%.2f,%d\n",
+                          green->timeIterations, green->frequency, green->dutyCycle, green->state,
+                          red->timeIterations, red->frequency, red->dutyCycle, red->state);
+    send(liveFeed, row, length, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+/* SWEEP RUNNER */
+
+/*
+Parses a comma separated list of numbers such as "1,2,5". Returns how many were read, or -1 on error.
+*/
+static int parseSweepList(const char *text, double *values, int max)
+{
+    int count = 0;
+    const char *p = text;
+
+    while (*p != '\0')
+    {
+        char *end;
+        double value = strtod(p, &end);
+
+        if (end == p || count == max)
+        {
+            return -1;
+        }
+        values[count++] = value;
+        while (*end == ' ')
+            end++;
+        if (*end == ',')
+            end++;
+        else if (*end != '\0' && *end != '\n')
+            return -1;
+        else
+            break;
+        p = end;
+    }
+    return count;
+}
+
+/*
+Sets one sweep option, key is the option name without "--". Returns 0, or -1 with a message if it is invalid.
+*/
+static int applySweepOption(struct sweepConfig *config, const char *key, const char *value)
+{
+    double values[SWEEP_MAX_VALUES];
+    int count;
+
+    if (strcmp(key, "freq") == 0)
+    {
+        count = parseSweepList(value, values, SWEEP_MAX_VALUES);
+        for (int i = 0; i < count; i++)
+        {
+            /* same range as the menu, except 0 Hz which has no period */
+            if (values[i] < 1 || values[i] > 10 || values[i] != (int)values[i])
+                count = -1;
+            else
+                config->frequencies[i] = (int)values[i];
+        }
+        if (count > 0)
+        {
+            config->frequencyCount = count;
+            return 0;
+        }
+        printf("Invalid frequency list \"%s\", use whole numbers between 1 and 10\n", value);
+        return -1;
+    }
+    if (strcmp(key, "duty") == 0)
+    {
+        count = parseSweepList(value, values, SWEEP_MAX_VALUES);
+        for (int i = 0; i < count; i++)
+        {
+            if (values[i] < 0 || values[i] > 100)
+                count = -1;
+            else
+                config->dutyCycles[i] = (float)values[i];
+        }
+        if (count > 0)
+        {
+            config->dutyCount = count;
+            return 0;
+        }
+        printf("Invalid duty cycle list \"%s\", use numbers between 0 and 100\n", value);
+        return -1;
+    }
+    if (strcmp(key, "duration") == 0)
+    {
+        config->seconds = atoi(value);
+        if (config->seconds >= 1 && config->seconds <= 3600)
+            return 0;
+        printf("Invalid duration \"%s\", use 1 to 3600 seconds\n", value);
+        return -1;
+    }
+    if (strcmp(key, "leds") == 0)
+    {
+        if (strncmp(value, "green", 5) == 0)
+            config->leds = BLINK_GREEN;
+        else if (strncmp(value, "red", 3) == 0)
+            config->leds = BLINK_RED;
+        else if (strncmp(value, "both", 4) == 0)
+            config->leds = SWEEP_BOTH;
+        else
+        {
+            printf("Invalid LEDs \"%s\", use green, red or both\n", value);
+            return -1;
+        }
+        return 0;
+    }
+    if (strcmp(key, "concurrent") == 0)
+    {
+        config->concurrent = atoi(value) != 0;
+        return 0;
+    }
+    if (strcmp(key, "out") == 0)
+    {
+        snprintf(config->outDir, sizeof(config->outDir), "%s", value);
+        config->outDir[strcspn(config->outDir, "\r\n")] = '\0';
+        return 0;
+    }
+    printf("Unknown sweep option \"%s\"\n", key);
+    return -1;
+}
+
+/*
+Reads "key = value" lines (the command line options without "--") from a sweep file, # starts a comment
+*/
+static int loadSweepConfig(struct sweepConfig *config, const char *fileName)
+{
+    char line[256];
+    FILE *file = fopen(fileName, "r");
+
+    if (file == NULL)
+    {
+        perror(fileName);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), file))
+    {
+        char key[32];
+        char value[200];
+
+        line[strcspn(line, "#\r\n")] = '\0';
+        if (sscanf(line, " %31[a-z] = %199[^\n]", key, value) != 2)
+        {
+            continue;
+        }
+        if (applySweepOption(config, key, value) != 0)
+        {
+            fclose(file);
+            return -1;
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+/*
+Reads the sweep options from the command line. Returns 0, or -1 after printing the usage.
+*/
+int parseSweepArgs(int argc, char *argv[], struct sweepConfig *config)
+{
+    memset(config, 0, sizeof(*config));
+    config->leds = BLINK_GREEN;
+    config->seconds = SWEEP_DEFAULT_SECONDS;
+    strcpy(config->outDir, SWEEP_DEFAULT_DIR);
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--concurrent") == 0)
+        {
+            config->concurrent = 1;
+        }
+        else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc)
+        {
+            if (loadSweepConfig(config, argv[++i]) != 0)
+                return -1;
+        }
+        else if (strncmp(argv[i], "--", 2) == 0 && i + 1 < argc && strcmp(argv[i], "--help") != 0)
+        {
+            if (applySweepOption(config, argv[i] + 2, argv[i + 1]) != 0)
+                return -1;
+            i++;
+        }
+        else
+        {
+            config->frequencyCount = 0;
+            break;
+        }
+    }
+
+    if (config->frequencyCount == 0 || config->dutyCount == 0)
+    {
+        printf("Usage: %s --freq 1,2,5 --duty 10,50,90 [--duration seconds] [--leds green|red|both]\n"
+               "       [--concurrent] [--out directory] [--config sweep.conf]\n"
+               "Without options the interactive menu is started.\n",
+               argv[0]);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+Blinks and records up to two LEDs (at most one green and one red) at once for durationMillis or until capacity
+samples are stored, one sample every 10ms per LED. Both menus and the sweep record through here.
+The LEDs are analysed into stats while recording, a LED that is not recorded stays empty.
+Returns the number of samples stored per channel.
+*/
+int recordChannels(struct sweepChannel *channels, int channelCount, int durationMillis, int capacity, struct pairStats *stats)
+{
+    struct CSV off = {0};
+    struct CSV *green = &off;
+    struct CSV *red = &off;
+    unsigned long currentMillis = millis();
+    unsigned long nextRecord = currentMillis;
+    unsigned long endMillis = currentMillis + durationMillis;
+    int iterations = 0;
+    int timeLapse = 0;
+    int liveFeed = openLiveFeed(); /* -1 when no live plot is listening */
+    struct ledData *greenLed = NULL;
+    struct ledData *redLed = NULL;
+
+    for (int c = 0; c < channelCount; c++)
+    {
+        channels[c].led.ledState = LOW;
+        channels[c].led.previousMillis = 0;
+        if (channels[c].led.blinkLed == GREEN)
+            greenLed = &channels[c].led;
+        else
+            redLed = &channels[c].led;
+    }
+    initPairStats(stats, greenLed ? greenLed->blinkFrequency : 0, greenLed ? greenLed->blinkBrightness : 0,
+                  redLed ? redLed->blinkFrequency : 0, redLed ? redLed->blinkBrightness : 0);
+    pwmEngineResetCounters();
+    telemetryStart(&recorderTelemetry, "record", SAMPLE_PERIOD_MICROS, capacity);
+
+    do
+    {
+        currentMillis = millis();
+        telemetryLoop(&recorderTelemetry);
+
+        for (int c = 0; c < channelCount; c++)
+        {
+            updateLED(&channels[c].led, currentMillis);
+        }
+
+        if (currentMillis >= nextRecord)
+        {
+            off.timeIterations = timeLapse;
+            for (int c = 0; c < channelCount; c++)
+            {
+                storeDataIntoMemory(channels[c].samples, &channels[c].led, timeLapse, iterations);
+            }
+            for (int c = 0; c < channelCount; c++)
+            {
+                if (channels[c].led.blinkLed == GREEN)
+                    green = &channels[c].samples[iterations];
+                else
+                    red = &channels[c].samples[iterations];
+            }
+            updatePairStats(stats, timeLapse, green->state, red->state);
+            sendLiveSample(liveFeed, green, red);
+            iterations++;
+            telemetrySample(&recorderTelemetry, iterations);
+            telemetryPublish(&recorderTelemetry, 0);
+            nextRecord = currentMillis + (10);
+            timeLapse += 10;
+        }
+    } while (currentMillis < endMillis && iterations < capacity);
+
+    for (int c = 0; c < channelCount; c++)
+    {
+        pwmEngineWrite(channels[c].led.blinkLed, 0);
+    }
+    if (liveFeed >= 0)
+    {
+        close(liveFeed);
+    }
+    telemetryPublish(&recorderTelemetry, 1);
+    return iterations;
+}
+
+/*
+Runs every frequency/duty cycle combination of the sweep back to back without any menu.
+With --concurrent two combinations run at the same time, one on each LED, which halves the sweep time.
+Each LED of each run is written to <out>/<led>_<freq>Hz_<duty>.csv (with --leds both one file holds both LEDs),
+and one tab separated line per result is added to <out>/summary.tsv (not .csv, so displayPlot --batch <out>
+does not take it for a capture). Returns 0 on success, 1 on error.
+*/
+int runSweep(struct sweepConfig *config)
+{
+    char fileName[256];
+    int runCount = config->frequencyCount * config->dutyCount;
+    int capacity = config->seconds * TO_MILLIS / 10 + 1;
+    int perRecording = config->concurrent && config->leds != SWEEP_BOTH ? 2 : 1;
+    struct sweepChannel channels[2];
+    struct pairStats pair;
+    int files = 0;
+
+    if (mkdir(config->outDir, 0755) != 0 && checkFileExist(config->outDir) == 0)
+    {
+        perror(config->outDir);
+        return 1;
+    }
+    channels[0].samples = malloc(capacity * sizeof(struct CSV));
+    channels[1].samples = malloc(capacity * sizeof(struct CSV));
+    snprintf(fileName, sizeof(fileName), "%s/summary.tsv", config->outDir);
+    FILE *summary = fopen(fileName, "w");
+
+    if (channels[0].samples == NULL || channels[1].samples == NULL || summary == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed");
+        free(channels[0].samples);
+        free(channels[1].samples);
+        if (summary != NULL)
+            fclose(summary);
+        return 1;
+    }
+    fprintf(summary, "LED\tFrequency\tDuty Cycle\tSamples\tMeasured Frequency\tMeasured Duty Cycle\tJitter\tMissed Toggles\tGlitches\tFile");
+
+    /* the LED starts off, so the first rising edge can come up to a period late and a frequency needs two of them */
+    for (int f = 0; f < config->frequencyCount; f++)
+    {
+        if (config->seconds * config->frequencies[f] <= 2)
+        {
+            fprintf(stderr, "Warning: %d s holds only %d period(s) of %d Hz, the frequency may be measured as 0 Hz. "
+                            "Use a --duration of at least %d s.\n",
+                    config->seconds, config->seconds * config->frequencies[f], config->frequencies[f],
+                    2 / config->frequencies[f] + 1);
+        }
+    }
+
+    printf("Sweep: %d runs of %d s, %s%s, writing to %s/\n", runCount, config->seconds,
+           config->leds == SWEEP_BOTH ? "both LEDs" : config->leds == BLINK_RED ? "red LED" : "green LED",
+           perRecording == 2 ? ", two runs at a time on green and red" : "", config->outDir);
+    printf("%-6s %5s %6s | %9s %7s %8s | %s\n", "LED", "Hz", "Duty", "Measured", "Duty", "Jitter", "File");
+    unsigned long startMillis = millis();
+
+    for (int run = 0; run < runCount; run += perRecording)
+    {
+        int channelCount = 0;
+
+        for (int k = run; k < run + perRecording && k < runCount; k++)
+        {
+            int frequency = config->frequencies[k / config->dutyCount];
+            float dutyCycle = config->dutyCycles[k % config->dutyCount];
+
+            if (config->leds == SWEEP_BOTH)
+            {
+                channels[channelCount++].led = (struct ledData){GREEN, frequency, dutyCycle, LOW, 0};
+                channels[channelCount++].led = (struct ledData){RED, frequency, dutyCycle, LOW, 0};
+            }
+            else
+            {
+                /* with --concurrent the first run of the pair goes to the selected LED, the second to the other one */
+                int green = (config->leds == BLINK_GREEN) == (k == run);
+                channels[channelCount++].led = (struct ledData){green ? GREEN : RED, frequency, dutyCycle, LOW, 0};
+            }
+        }
+
+        int samples = recordChannels(channels, channelCount, config->seconds * TO_MILLIS, capacity, &pair);
+
+        for (int c = 0; c < channelCount; c++)
+        {
+            struct ledData *led = &channels[c].led;
+            struct waveStats *stats = led->blinkLed == GREEN ? &pair.green : &pair.red;
+            const char *name = config->leds == SWEEP_BOTH ? "both" : led->blinkLed == GREEN ? "green" : "red";
+
+            if (config->leds != SWEEP_BOTH || c == 0)
+            {
+                struct CSV *green = led->blinkLed == GREEN ? channels[c].samples : config->leds == SWEEP_BOTH ? channels[1 - c].samples : NULL;
+                struct CSV *red = led->blinkLed == RED ? channels[c].samples : config->leds == SWEEP_BOTH ? channels[1 - c].samples : NULL;
+
+                snprintf(fileName, sizeof(fileName), "%s/%s_%dHz_%g.csv", config->outDir, name, led->blinkFrequency, led->blinkBrightness);
+                if (writeCaptureFile(fileName, green, red, samples) == 0)
+                    files++;
+            }
+            printf("%-6s %5d %5.1f%% | %6.2f Hz %6.1f%% %5.2f ms | %s\n", led->blinkLed == GREEN ? "green" : "red",
+                   led->blinkFrequency, led->blinkBrightness, measuredFrequency(stats), measuredDutyCycle(stats),
+                   periodJitter(stats), fileName);
+            fprintf(summary, "\n%s\t%d\t%.2f\t%ld\t%.3f\t%.2f\t%.3f\t%ld\t%ld\t%s", led->blinkLed == GREEN ? "green" : "red",
+                    led->blinkFrequency, led->blinkBrightness, stats->samples, measuredFrequency(stats),
+                    measuredDutyCycle(stats), periodJitter(stats), stats->missedToggles, stats->glitches, fileName);
+        }
+    }
+
+    printf("Sweep done: %d captures in %.1f s, summary in %s/summary.tsv\n", files, (millis() - startMillis) / 1000.0, config->outDir);
+    printTelemetry(stdout, &recorderTelemetry);
+    fclose(summary);
+    free(channels[0].samples);
+    free(channels[1].samples);
+    return 0;
+}
+
 /*
 Resetting and cleaning up before safely exiting the program.
 */
 void endProgram()
 {
-    system("clear");
+    if (interactive)
+        system("clear");
     printf("\nCleaning Up...\n");
-    // Turn Off LEDs
-    digitalWrite(GREEN, LOW);
-    digitalWrite(RED, LOW);
-
-    // Turn Off LED Software PWM
-    softPwmWrite(GREEN, 0);
-    softPwmWrite(RED, 0);
+    // Stop the PWM engine thread, it switches every LED off
+    pwmEngineStop();
 
     // Reset Pins to Original INPUT State
     pinMode(GREEN, INPUT);
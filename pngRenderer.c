@@ -0,0 +1,555 @@
+/*
+pngRenderer.c
+
+Rasterizes a capture into a palette image and writes it as a PNG file, see pngRenderer.h.
+The layout follows gnuPlot(): a green panel on top and a red panel below sharing the time axis,
+y range -0.5 to 1.5 with tics at 0 and 1, and the configured and measured values in the titles.
+*/
+
+// header files
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pngRenderer.h"
+
+// DEFINITIONS
+#define FONT_WIDTH 5
+#define FONT_HEIGHT 7
+#define CHAR_ADVANCE 6 // font width plus one pixel of spacing
+#define TITLE_LENGTH 128
+#define TICK_LENGTH 5
+#define MAX_MATCH 258 // longest match deflate can encode
+
+// palette indices
+#define WHITE 0
+#define BLACK 1
+#define GREEN 2
+#define RED 3
+
+// margins in the same screen fractions as gnuPlot()
+#define LEFT_MARGIN 60
+#define RIGHT_MARGIN 20
+#define TOP_PANEL_TOP (PNG_HEIGHT * 15 / 100)    // tmargin at screen 0.85
+#define PANEL_SPLIT (PNG_HEIGHT * 55 / 100)      // bmargin 0.45 / tmargin 0.45
+#define BOTTOM_PANEL_BOTTOM (PNG_HEIGHT * 90 / 100) // bmargin at screen 0.1
+
+static const unsigned char palette[][3] = {
+    {0xFF, 0xFF, 0xFF}, // white background
+    {0x00, 0x00, 0x00}, // black axes and text
+    {0x00, 0x99, 0x33}, // green LED, '#009933' in gnuPlot()
+    {0xFF, 0x00, 0x00}, // red LED
+};
+
+// 5x7 font, one byte per row with the leftmost pixel in bit 4. Lower case letters are drawn in upper case.
+static const char fontChars[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ.,%()-:/";
+static const unsigned char fontRows[][FONT_HEIGHT] = {
+    {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E}, // 0
+    {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E}, // 1
+    {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F}, // 2
+    {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E}, // 3
+    {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02}, // 4
+    {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E}, // 5
+    {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E}, // 6
+    {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08}, // 7
+    {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E}, // 8
+    {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C}, // 9
+    {0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11}, // A
+    {0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E}, // B
+    {0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E}, // C
+    {0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C}, // D
+    {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F}, // E
+    {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10}, // F
+    {0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F}, // G
+    {0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11}, // H
+    {0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E}, // I
+    {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C}, // J
+    {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11}, // K
+    {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F}, // L
+    {0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11}, // M
+    {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11}, // N
+    {0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}, // O
+    {0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10}, // P
+    {0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D}, // Q
+    {0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11}, // R
+    {0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E}, // S
+    {0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04}, // T
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}, // U
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04}, // V
+    {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A}, // W
+    {0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11}, // X
+    {0x11, 0x11, 0x0A, 0x04, 0x04, 0x04, 0x04}, // Y
+    {0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F}, // Z
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C}, // .
+    {0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08}, // ,
+    {0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03}, // %
+    {0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02}, // (
+    {0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08}, // )
+    {0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00}, // -
+    {0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00}, // :
+    {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00}, // /
+};
+
+struct canvas
+{
+    unsigned char pixels[PNG_HEIGHT][PNG_WIDTH];
+};
+
+struct panel
+{
+    int left, right, top, bottom; // pixel bounds of the plot area
+    double timeStart, timeEnd;    // time range of the x axis
+};
+
+struct byteBuffer
+{
+    unsigned char *data;
+    size_t length;
+    size_t capacity;
+    int failed; // set if memory ran out
+};
+
+struct bitWriter
+{
+    struct byteBuffer *out;
+    uint32_t bits; // bits not yet written, lowest bit first
+    int count;
+};
+
+/* DRAWING */
+
+static void setPixel(struct canvas *image, int x, int y, unsigned char color)
+{
+    if (x >= 0 && x < PNG_WIDTH && y >= 0 && y < PNG_HEIGHT)
+    {
+        image->pixels[y][x] = color;
+    }
+}
+
+static void drawHorizontal(struct canvas *image, int x0, int x1, int y, unsigned char color)
+{
+    if (x0 > x1)
+    {
+        int swap = x0;
+        x0 = x1;
+        x1 = swap;
+    }
+    for (int x = x0; x <= x1; x++)
+    {
+        setPixel(image, x, y, color);
+    }
+}
+
+static void drawVertical(struct canvas *image, int x, int y0, int y1, unsigned char color)
+{
+    if (y0 > y1)
+    {
+        int swap = y0;
+        y0 = y1;
+        y1 = swap;
+    }
+    for (int y = y0; y <= y1; y++)
+    {
+        setPixel(image, x, y, color);
+    }
+}
+
+static void drawText(struct canvas *image, int x, int y, const char *text, unsigned char color)
+{
+    for (; *text; text++, x += CHAR_ADVANCE)
+    {
+        char c = (*text >= 'a' && *text <= 'z') ? *text - 'a' + 'A' : *text;
+        const char *found = c == ' ' ? NULL : strchr(fontChars, c);
+
+        if (found == NULL)
+        {
+            continue; // space or a character the font does not have
+        }
+        const unsigned char *rows = fontRows[found - fontChars];
+        for (int row = 0; row < FONT_HEIGHT; row++)
+        {
+            for (int col = 0; col < FONT_WIDTH; col++)
+            {
+                if (rows[row] & (0x10 >> col))
+                {
+                    setPixel(image, x + col, y + row, color);
+                }
+            }
+        }
+    }
+}
+
+static void drawTextCentered(struct canvas *image, int centerX, int y, const char *text, unsigned char color)
+{
+    drawText(image, centerX - (int)strlen(text) * CHAR_ADVANCE / 2, y, text, color);
+}
+
+static int mapX(const struct panel *area, double time)
+{
+    double span = area->timeEnd > area->timeStart ? area->timeEnd - area->timeStart : 1;
+    return area->left + (int)((time - area->timeStart) / span * (area->right - area->left) + 0.5);
+}
+
+static int mapY(const struct panel *area, int state)
+{
+    // yrange [-0.5:1.5]: 1 is a quarter of the way down, 0 three quarters
+    return area->top + (area->bottom - area->top) * (state ? 1 : 3) / 4;
+}
+
+/*
+Draws the step waveform of one state column. Only the state changes are drawn as vertical lines,
+so the cost is one bit test per sample plus the pixels of the lines.
+*/
+static void drawWaveform(struct canvas *image, const struct panel *area, const struct captureStore *store,
+                         const uint64_t *state, size_t first, size_t count, unsigned char color)
+{
+    int level = sampleState(state, first);
+    int segmentStart = mapX(area, store->time[first]);
+
+    for (size_t i = first + 1; i < first + count; i++)
+    {
+        int next = sampleState(state, i);
+        if (next != level)
+        {
+            int x = mapX(area, store->time[i]);
+            drawHorizontal(image, segmentStart, x, mapY(area, level), color);
+            drawVertical(image, x, mapY(area, level), mapY(area, next), color);
+            segmentStart = x;
+            level = next;
+        }
+    }
+    drawHorizontal(image, segmentStart, mapX(area, store->time[first + count - 1]), mapY(area, level), color);
+}
+
+static void drawYTics(struct canvas *image, const struct panel *area)
+{
+    for (int state = 0; state <= 1; state++)
+    {
+        int y = mapY(area, state);
+        drawHorizontal(image, area->left, area->left + TICK_LENGTH, y, BLACK);
+        drawText(image, area->left - 2 * CHAR_ADVANCE, y - FONT_HEIGHT / 2, state ? "1" : "0", BLACK);
+    }
+}
+
+/*
+Picks about 5 to 10 x tics at 1, 2 or 5 times a power of ten, like gnuplot's "set xtics auto"
+*/
+static void drawXTics(struct canvas *image, const struct panel *area)
+{
+    double span = area->timeEnd - area->timeStart;
+    char label[32];
+
+    if (span <= 0)
+    {
+        return;
+    }
+    double step = pow(10, floor(log10(span / 5)));
+    if (span / step > 10)
+    {
+        step *= 2;
+    }
+    if (span / step > 10)
+    {
+        step *= 2.5;
+    }
+
+    for (double tic = step * (long long)(area->timeStart / step); tic <= area->timeEnd; tic += step)
+    {
+        if (tic < area->timeStart)
+        {
+            continue;
+        }
+        int x = mapX(area, tic);
+        drawVertical(image, x, area->bottom - TICK_LENGTH, area->bottom, BLACK);
+        snprintf(label, sizeof(label), "%.0f", tic);
+        drawTextCentered(image, x, area->bottom + 6, label, BLACK);
+    }
+}
+
+/* PNG ENCODING */
+
+static void putByte(struct byteBuffer *buffer, unsigned char byte)
+{
+    if (buffer->length == buffer->capacity)
+    {
+        size_t capacity = buffer->capacity ? buffer->capacity * 2 : 65536;
+        unsigned char *data = realloc(buffer->data, capacity);
+        if (data == NULL)
+        {
+            buffer->failed = 1;
+            return;
+        }
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+    buffer->data[buffer->length++] = byte;
+}
+
+static void put32(struct byteBuffer *buffer, uint32_t value)
+{
+    putByte(buffer, value >> 24);
+    putByte(buffer, value >> 16);
+    putByte(buffer, value >> 8);
+    putByte(buffer, value);
+}
+
+static void writeBits(struct bitWriter *writer, uint32_t value, int count)
+{
+    writer->bits |= value << writer->count;
+    writer->count += count;
+    while (writer->count >= 8)
+    {
+        putByte(writer->out, writer->bits & 0xFF);
+        writer->bits >>= 8;
+        writer->count -= 8;
+    }
+}
+
+/*
+Huffman codes are packed starting with their most significant bit
+*/
+static void writeCode(struct bitWriter *writer, uint32_t code, int length)
+{
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; i++)
+    {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    writeBits(writer, reversed, length);
+}
+
+/*
+Writes a literal/length symbol with the fixed Huffman code of deflate (RFC 1951 section 3.2.6)
+*/
+static void writeSymbol(struct bitWriter *writer, int symbol)
+{
+    if (symbol < 144)
+        writeCode(writer, 0x30 + symbol, 8);
+    else if (symbol < 256)
+        writeCode(writer, 0x190 + symbol - 144, 9);
+    else if (symbol < 280)
+        writeCode(writer, symbol - 256, 7);
+    else
+        writeCode(writer, 0xC0 + symbol - 280, 8);
+}
+
+static void writeMatch(struct bitWriter *writer, int length, int distance)
+{
+    static const int lengthBase[] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const int lengthExtra[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const int distanceBase[] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+    static const int distanceExtra[] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+    int code = 28;
+    while (lengthBase[code] > length)
+    {
+        code--;
+    }
+    writeSymbol(writer, 257 + code);
+    writeBits(writer, length - lengthBase[code], lengthExtra[code]);
+
+    code = 29;
+    while (distanceBase[code] > distance)
+    {
+        code--;
+    }
+    writeCode(writer, code, 5); // fixed distance codes are 5 bits
+    writeBits(writer, distance - distanceBase[code], distanceExtra[code]);
+}
+
+static size_t matchLength(const unsigned char *data, size_t position, size_t distance, size_t length)
+{
+    size_t limit = length - position < MAX_MATCH ? length - position : MAX_MATCH;
+    size_t matched = 0;
+
+    while (matched < limit && data[position + matched] == data[position + matched - distance])
+    {
+        matched++;
+    }
+    return matched;
+}
+
+/*
+zlib stream with one fixed Huffman deflate block. At every position the encoder tries a run of the
+previous byte and a copy of the row above and keeps the longer one. Waveform images are mostly
+background, so this gets close to a full deflate at a fraction of the cost.
+*/
+static void deflateImage(struct byteBuffer *out, const unsigned char *data, size_t length, size_t rowLength)
+{
+    struct bitWriter writer = {out, 0, 0};
+    uint32_t adlerA = 1, adlerB = 0;
+    size_t i = 0;
+
+    putByte(out, 0x78); // zlib header: deflate, 32K window
+    putByte(out, 0x01);
+    writeBits(&writer, 1, 1); // last block
+    writeBits(&writer, 1, 2); // fixed Huffman codes
+
+    while (i < length)
+    {
+        size_t best = 0, distance = 0;
+
+        if (i >= 1)
+        {
+            best = matchLength(data, i, 1, length);
+            distance = 1;
+        }
+        if (i >= rowLength && best < MAX_MATCH)
+        {
+            size_t rowMatch = matchLength(data, i, rowLength, length);
+            if (rowMatch > best)
+            {
+                best = rowMatch;
+                distance = rowLength;
+            }
+        }
+
+        if (best >= 3)
+        {
+            writeMatch(&writer, (int)best, (int)distance);
+            i += best;
+        }
+        else
+        {
+            writeSymbol(&writer, data[i]);
+            i++;
+        }
+    }
+    writeSymbol(&writer, 256); // end of block
+    if (writer.count > 0)
+    {
+        writeBits(&writer, 0, 8 - writer.count);
+    }
+
+    for (i = 0; i < length; i++)
+    {
+        adlerA = (adlerA + data[i]) % 65521;
+        adlerB = (adlerB + adlerA) % 65521;
+    }
+    put32(out, (adlerB << 16) | adlerA);
+}
+
+/*
+Runs the PNG CRC-32 register over more bytes. Start with 0xFFFFFFFF and invert the result at the end.
+*/
+static uint32_t updateCrc(uint32_t crc, const unsigned char *data, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return crc;
+}
+
+/*
+Writes one PNG chunk: length, type, data and the CRC over type and data
+*/
+static void writeChunk(FILE *file, const char *type, const unsigned char *data, size_t length)
+{
+    unsigned char header[8] = {length >> 24, length >> 16, length >> 8, length, type[0], type[1], type[2], type[3]};
+    uint32_t crc = ~updateCrc(updateCrc(0xFFFFFFFF, header + 4, 4), data, length);
+    unsigned char trailer[4] = {crc >> 24, crc >> 16, crc >> 8, crc};
+
+    fwrite(header, 1, 8, file);
+    if (length > 0) // IEND has no data and passes NULL
+    {
+        fwrite(data, 1, length, file);
+    }
+    fwrite(trailer, 1, 4, file);
+}
+
+static int writePng(const struct canvas *image, const char *fileName)
+{
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    unsigned char header[13] = {PNG_WIDTH >> 24, PNG_WIDTH >> 16, PNG_WIDTH >> 8, PNG_WIDTH & 0xFF,
+                                PNG_HEIGHT >> 24, PNG_HEIGHT >> 16, PNG_HEIGHT >> 8, PNG_HEIGHT & 0xFF,
+                                8, 3, 0, 0, 0}; // 8 bit palette, deflate, no filter, no interlace
+    size_t rowLength = PNG_WIDTH + 1;          // filter byte plus the pixels
+    struct byteBuffer compressed = {0};
+
+    unsigned char *raw = malloc(rowLength * PNG_HEIGHT);
+    if (raw == NULL)
+    {
+        return -1;
+    }
+    for (int y = 0; y < PNG_HEIGHT; y++)
+    {
+        raw[y * rowLength] = 0; // filter type None
+        memcpy(raw + y * rowLength + 1, image->pixels[y], PNG_WIDTH);
+    }
+    deflateImage(&compressed, raw, rowLength * PNG_HEIGHT, rowLength);
+    free(raw);
+
+    FILE *file = fopen(fileName, "wb");
+    if (compressed.failed || file == NULL)
+    {
+        free(compressed.data);
+        if (file != NULL)
+        {
+            fclose(file);
+        }
+        return -1;
+    }
+
+    fwrite(signature, 1, sizeof(signature), file);
+    writeChunk(file, "IHDR", header, sizeof(header));
+    writeChunk(file, "PLTE", &palette[0][0], sizeof(palette));
+    writeChunk(file, "IDAT", compressed.data, compressed.length);
+    writeChunk(file, "IEND", NULL, 0);
+
+    free(compressed.data);
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+/*
+Renders count samples starting at first into a PNG file. Returns 0 on success, -1 on error.
+*/
+int renderCapturePng(const struct captureStore *store, size_t first, size_t count, const struct pairStats *stats, const char *fileName)
+{
+    char title[TITLE_LENGTH];
+
+    if (count == 0)
+    {
+        return -1;
+    }
+
+    struct canvas *image = malloc(sizeof(struct canvas));
+    if (image == NULL)
+    {
+        return -1;
+    }
+    memset(image->pixels, WHITE, sizeof(image->pixels));
+
+    const struct captureRun *run = captureRunAt(store, first);
+    struct panel top = {LEFT_MARGIN, PNG_WIDTH - RIGHT_MARGIN, TOP_PANEL_TOP, PANEL_SPLIT,
+                        store->time[first], store->time[first + count - 1]};
+    struct panel bottom = top;
+    bottom.top = PANEL_SPLIT;
+    bottom.bottom = BOTTOM_PANEL_BOTTOM;
+
+    // first plot: green LED, left border only (border 2)
+    snprintf(title, sizeof(title), "Blink Green LED at %d Hz, %.0f%% duty cycle (measured %.2f Hz, %.1f%%)",
+             run->greenFrequency, run->greenDutyCycle, measuredFrequency(&stats->green), measuredDutyCycle(&stats->green));
+    drawTextCentered(image, (top.left + top.right) / 2, top.top - 2 * FONT_HEIGHT, title, BLACK);
+    drawVertical(image, top.left, top.top, top.bottom, BLACK);
+    drawYTics(image, &top);
+    drawWaveform(image, &top, store, store->greenState, first, count, GREEN);
+
+    // second plot: red LED, left and bottom border (border 3) and the time axis
+    snprintf(title, sizeof(title), "Blink Red LED at %d Hz, %.0f%% duty cycle (measured %.2f Hz, %.1f%%)",
+             run->redFrequency, run->redDutyCycle, measuredFrequency(&stats->red), measuredDutyCycle(&stats->red));
+    drawTextCentered(image, (bottom.left + bottom.right) / 2, bottom.top - 2 * FONT_HEIGHT, title, BLACK);
+    drawVertical(image, bottom.left, bottom.top, bottom.bottom, BLACK);
+    drawHorizontal(image, bottom.left, bottom.right, bottom.bottom, BLACK);
+    drawYTics(image, &bottom);
+    drawXTics(image, &bottom);
+    drawWaveform(image, &bottom, store, store->redState, first, count, RED);
+
+    int result = writePng(image, fileName);
+    free(image);
+    return result;
+}
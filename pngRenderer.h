@@ -0,0 +1,21 @@
+/*
+pngRenderer.h
+
+Headless renderer for LED waveform captures.
+Draws the same two-panel step waveform layout as gnuPlot() in displayPlot.c into an in-memory
+palette image and encodes it as PNG (deflate with run and previous-row matches), without gnuplot.
+*/
+
+#ifndef PNG_RENDERER_H
+#define PNG_RENDERER_H
+
+#include <stddef.h>
+#include "captureStore.h"
+#include "waveAnalyser.h"
+
+#define PNG_WIDTH 640  // same size as gnuplot's png terminal
+#define PNG_HEIGHT 480
+
+int renderCapturePng(const struct captureStore *store, size_t first, size_t count, const struct pairStats *stats, const char *fileName);
+
+#endif
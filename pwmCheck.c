@@ -0,0 +1,113 @@
+/*
+pwmCheck.c
+
+Checks the PWM engine on the simulated GPIO backend: for a set of commanded values the duty cycle the engine
+counted (pwmEngineDutyCycle) must be exactly the commanded one, the duty cycle the simulated pins were
+really high (simulatedDutyCycle) must be close to it, also after a counter reset, and the level the engine
+read back (pwmEngineState) must be on for every channel with a value above 0.
+A round in which the engine thread was held up (pwmEngineLatePeriods) is measured again up to MAX_ATTEMPTS
+times. If every attempt had late periods, each of them may have shifted the duty cycle by up to one whole
+period, so the allowed difference grows by the share of late periods.
+
+=== HOW TO RUN ===
+gcc -o pwmCheck pwmCheck.c pwmEngine.c telemetry.c -lm -pthread
+./pwmCheck
+Exits with 0 if every channel is within PWM_TOLERANCE, 1 otherwise.
+*/
+
+// header files
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+#include "pwmEngine.h"
+
+// DEFINITIONS
+#define PWM_RANGE 100       // same engine settings as newStudent.c, 100Hz
+#define PWM_TICK_MICROS 100
+#define MEASURE_MILLIS 1000 // measuring time of one round
+#define PWM_TOLERANCE 2.0   // percentage points (two ticks) the simulated pins may differ from the engine, for thread wake-up latency
+#define CHANNELS 5
+#define MAX_ATTEMPTS 3      // measurements of a round while it has late periods
+#define PERIOD_MICROS (PWM_RANGE * PWM_TICK_MICROS)
+
+static void sleepMillis(long millis)
+{
+    struct timespec time = {millis / 1000, (millis % 1000) * 1000000L};
+    nanosleep(&time, NULL);
+}
+
+/*
+Commands the values, resets the counters and compares engine and simulated pins after MEASURE_MILLIS.
+Returns the number of channels that failed.
+*/
+static int checkRound(const char *name, const int pins[], const int values[])
+{
+    int failures = 0;
+    unsigned long late = 0;
+
+    for (int c = 0; c < CHANNELS; c++)
+    {
+        pwmEngineWrite(pins[c], values[c]);
+    }
+    sleepMillis(20); // let the new values take effect before measuring
+
+    printf("%s\n", name);
+    for (int attempt = 1; attempt <= MAX_ATTEMPTS; attempt++)
+    {
+        pwmEngineResetCounters();
+        sleepMillis(MEASURE_MILLIS);
+        late = pwmEngineLatePeriods();
+        if (late == 0)
+        {
+            break;
+        }
+        printf("  engine thread was held up in %lu periods, measuring again\n", late);
+    }
+    double lateShare = 100.0 * late * PERIOD_MICROS / (MEASURE_MILLIS * 1000.0);
+    if (late > 0)
+    {
+        printf("  still %lu late periods, allowing %.1f more percentage points\n", late, lateShare);
+    }
+
+    for (int c = 0; c < CHANNELS; c++)
+    {
+        double engine = pwmEngineDutyCycle(pins[c]);
+        double simulated = simulatedDutyCycle(pins[c]);
+        double commanded = 100.0 * values[c] / PWM_RANGE;
+        int state = pwmEngineState(pins[c]);
+        int ok = fabs(engine - commanded) <= lateShare && fabs(simulated - engine) <= PWM_TOLERANCE + lateShare &&
+                 state == (values[c] > 0);
+
+        printf("  pin %2d  commanded %3d%%  engine %6.2f%%  simulated %6.2f%%  read %s  %s\n",
+               pins[c], values[c] * 100 / PWM_RANGE, engine, simulated, state ? "on " : "off", ok ? "ok" : "FAIL");
+        failures += !ok;
+    }
+    return failures;
+}
+
+int main(void)
+{
+    const int pins[CHANNELS] = {5, 6, 13, 19, 27};
+    const int first[CHANNELS] = {0, 25, 50, 75, 100};
+    const int second[CHANNELS] = {100, 10, 90, 33, 0};
+    int failures = 0;
+
+    if (pwmEngineStart(&simulatedPwmBackend, PWM_RANGE, PWM_TICK_MICROS, 0) != 0)
+    {
+        printf("Cannot start the PWM engine\n");
+        return 1;
+    }
+    for (int c = 0; c < CHANNELS; c++)
+    {
+        pwmEngineAddChannel(pins[c]);
+    }
+
+    failures += checkRound("Round 1", pins, first);
+    // the fully on channel of round 1 is not written again, the reset must still count it
+    failures += checkRound("Round 2, new values after a reset", pins, second);
+    failures += checkRound("Round 3, same values after another reset", pins, second);
+
+    pwmEngineStop();
+    printf(failures == 0 ? "PWM engine check passed\n" : "PWM engine check FAILED (%d channels)\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,545 @@
+/*
+pwmEngine.c
+
+One thread drives all PWM channels from a sorted edge timeline, see pwmEngine.h.
+Each period is range ticks of tickMicros microseconds. A channel with value v is high for the first v ticks.
+*/
+
+// header files
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "pwmEngine.h"
+#include "telemetry.h"
+
+// DEFINITIONS
+#define SIMULATED_PINS 64 // number of GPIO pins the simulated backend knows about
+#define LATE_TICKS 2      // a period with an edge written more than this many ticks late counts as late
+
+struct pwmChannel
+{
+    int pin;
+    int hardware;                  // 1 if the pin is driven by a hardware PWM channel
+    int value;                     // commanded value, 0 to range, written by pwmEngineWrite
+    int level;                     // last level written to the pin, -1 if unknown
+    int state;                     // level read back from the pin in the latest period, see observeChannel
+    unsigned long long onTicks;    // ticks the channel was commanded high, written by the engine thread only
+    unsigned long long totalTicks; // ticks the engine has run, written by the engine thread only
+};
+
+struct pwmEdge
+{
+    int value;
+    struct pwmChannel *channel;
+};
+
+static struct pwmChannel channels[PWM_MAX_CHANNELS];
+static int channelCount = 0;
+static const struct pwmBackend *engineBackend;
+static int engineRange;
+static int engineTickMicros;
+static int engineUseHardware;
+static int engineRunning = 0; // read by the engine thread, always accessed atomically
+static pthread_t engineThread;
+
+// counters of the engine thread (GPIO call time, period lateness, late periods), published next to the recorder's
+static _Thread_local struct telemetry engineTelemetry;
+
+// the tick counters are only written by the engine thread. Readers check statsSequence before and after
+// reading (odd while the engine is updating) and retry, so onTicks and totalTicks always match
+static unsigned statsSequence = 0;
+// pwmEngineResetCounters asks for a reset by raising resetRequested, the engine thread does it at the start
+// of the next period and then sets resetDone to the same number
+static unsigned resetRequested = 0;
+static unsigned resetDone = 0;
+// periods in which an edge was written more than LATE_TICKS late or that were missed, since the last reset
+static unsigned long latePeriods = 0;
+
+/*
+Pins with a hardware PWM channel on the Raspberry Pi (BCM numbering)
+*/
+int isHardwarePwmPin(int pin)
+{
+    return pin == 12 || pin == 13 || pin == 18 || pin == 19;
+}
+
+static void addMicros(struct timespec *time, long micros)
+{
+    time->tv_nsec += micros * 1000L;
+    while (time->tv_nsec >= 1000000000L)
+    {
+        time->tv_nsec -= 1000000000L;
+        time->tv_sec++;
+    }
+}
+
+static long microsSince(const struct timespec *time)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - time->tv_sec) * 1000000L + (now.tv_nsec - time->tv_nsec) / 1000L;
+}
+
+/*
+Sleeps until an absolute monotonic time, so the error of one sleep does not add up over the periods.
+Returns 1 if the thread woke up more than LATE_TICKS ticks late.
+*/
+static int sleepUntil(const struct timespec *time)
+{
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, time, NULL) != 0 && __atomic_load_n(&engineRunning, __ATOMIC_RELAXED))
+        ;
+    return microsSince(time) > LATE_TICKS * engineTickMicros;
+}
+
+static void setLevel(struct pwmChannel *channel, int level)
+{
+    if (channel->level != level)
+    {
+        uint64_t gpioStart = telemetryGpioStart(&engineTelemetry);
+        engineBackend->write(channel->pin, level);
+        telemetryGpio(&engineTelemetry, gpioStart);
+        channel->level = level;
+    }
+}
+
+/*
+Reads a software channel back right after the period start has switched it on or off, the one moment its
+PWM carrier is known to be high if the channel is on, and publishes the level for pwmEngineState.
+Without a read function in the backend the level written is published instead.
+*/
+static void observeChannel(struct pwmChannel *channel)
+{
+    int state = channel->level > 0;
+
+    if (engineBackend->read != NULL)
+    {
+        uint64_t gpioStart = telemetryGpioStart(&engineTelemetry);
+        state = engineBackend->read(channel->pin) != 0;
+        telemetryGpio(&engineTelemetry, gpioStart);
+    }
+    __atomic_store_n(&channel->state, state, __ATOMIC_RELAXED);
+}
+
+static void sleepMillis(long millis)
+{
+    struct timespec time = {millis / 1000, (millis % 1000) * 1000000L};
+    nanosleep(&time, NULL);
+}
+
+/*
+Handles a pending reset request and adds periods periods to the tick counters of every channel,
+values[i] ticks high in each of them
+*/
+static void countPeriods(const int values[], int count, long periods, int late)
+{
+    unsigned request = __atomic_load_n(&resetRequested, __ATOMIC_ACQUIRE);
+    int reset = request != resetDone;
+
+    // release stores: a reader that sees a new counter value also sees the odd sequence number before it
+    __atomic_store_n(&statsSequence, statsSequence + 1, __ATOMIC_RELAXED);
+    for (int i = 0; i < count; i++)
+    {
+        struct pwmChannel *channel = &channels[i];
+
+        __atomic_store_n(&channel->onTicks, (reset ? 0 : channel->onTicks) + values[i] * periods, __ATOMIC_RELEASE);
+        __atomic_store_n(&channel->totalTicks, (reset ? 0 : channel->totalTicks) + engineRange * periods, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&statsSequence, statsSequence + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&latePeriods, (reset ? 0 : latePeriods) + (late ? periods : 0), __ATOMIC_RELAXED);
+
+    if (reset)
+    {
+        if (engineBackend->resetCounters != NULL)
+        {
+            engineBackend->resetCounters();
+        }
+        __atomic_store_n(&resetDone, request, __ATOMIC_RELEASE);
+    }
+}
+
+/*
+The engine thread. Every period:
+1. takes a snapshot of the channel values, so each period has exactly the commanded duty cycle
+2. counts the period, restarting the counters first if a reset was requested
+3. switches on every channel with a value above 0 and sorts the switch-off edges
+4. reads every channel back while its carrier is high, so pwmEngineState reports what the pin did
+5. sleeps until each edge and switches that channel off
+If the thread was held up for whole periods, they are not replayed: the pins kept their levels meanwhile,
+so the missed periods are counted at those levels and the timeline moves on to the next period start.
+The thread's telemetry is published after the edges, when the pins need nothing until the next period.
+*/
+static void *runEngine(void *arg)
+{
+    struct pwmEdge edges[PWM_MAX_CHANNELS];
+    int values[PWM_MAX_CHANNELS];
+    struct timespec periodStart;
+    int late = 0; // the current period started late
+
+    (void)arg;
+    telemetryStart(&engineTelemetry, PWM_ENGINE_THREAD, engineRange * engineTickMicros, 0);
+    clock_gettime(CLOCK_MONOTONIC, &periodStart);
+
+    while (__atomic_load_n(&engineRunning, __ATOMIC_RELAXED))
+    {
+        int edgeCount = 0;
+        int count = __atomic_load_n(&channelCount, __ATOMIC_ACQUIRE);
+
+        telemetryLoop(&engineTelemetry);
+        telemetrySample(&engineTelemetry, 0);
+        if (late)
+        {
+            telemetryLate(&engineTelemetry, 1);
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            values[i] = __atomic_load_n(&channels[i].value, __ATOMIC_RELAXED);
+        }
+        countPeriods(values, count, 1, late);
+
+        for (int i = 0; i < count; i++)
+        {
+            struct pwmChannel *channel = &channels[i];
+            int value = values[i];
+
+            if (channel->hardware)
+            {
+                // the hardware carrier does not run in step with the engine, so it is not read back
+                __atomic_store_n(&channel->state, value > 0, __ATOMIC_RELAXED);
+                continue;
+            }
+
+            setLevel(channel, value > 0);
+            if (value > 0 && value < engineRange)
+            {
+                // insertion sort, there are only a few channels
+                int k = edgeCount++;
+                while (k > 0 && edges[k - 1].value > value)
+                {
+                    edges[k] = edges[k - 1];
+                    k--;
+                }
+                edges[k] = (struct pwmEdge){value, channel};
+            }
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            if (!channels[i].hardware)
+            {
+                observeChannel(&channels[i]);
+            }
+        }
+
+        for (int k = 0; k < edgeCount; k++)
+        {
+            struct timespec edgeTime = periodStart;
+            addMicros(&edgeTime, (long)edges[k].value * engineTickMicros);
+            if (sleepUntil(&edgeTime) && !late)
+            {
+                late = 1;
+                __atomic_store_n(&latePeriods, latePeriods + 1, __ATOMIC_RELAXED);
+                telemetryLate(&engineTelemetry, 1);
+            }
+            setLevel(edges[k].channel, 0);
+        }
+        telemetryPublish(&engineTelemetry, 0);
+
+        addMicros(&periodStart, (long)engineRange * engineTickMicros);
+
+        long missed = microsSince(&periodStart) / ((long)engineRange * engineTickMicros);
+
+        if (missed > 0)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                values[i] = channels[i].hardware ? values[i] : channels[i].level > 0 ? engineRange : 0;
+            }
+            countPeriods(values, count, missed, 1);
+            addMicros(&periodStart, missed * engineRange * engineTickMicros);
+        }
+        late = sleepUntil(&periodStart);
+    }
+    telemetryPublish(&engineTelemetry, 1);
+    return NULL;
+}
+
+/*
+Starts the engine thread. range is the number of steps per period and tickMicros the length of one step,
+so the PWM frequency is 1000000 / (range * tickMicros) Hz. With useHardware set, channels on hardware PWM
+pins are driven by the hardware. Returns 0 on success, -1 on error.
+*/
+int pwmEngineStart(const struct pwmBackend *backend, int range, int tickMicros, int useHardware)
+{
+    struct sched_param param;
+    pthread_attr_t attr;
+
+    if (__atomic_load_n(&engineRunning, __ATOMIC_RELAXED) || range <= 0 || tickMicros <= 0)
+    {
+        return -1;
+    }
+
+    engineBackend = backend;
+    engineRange = range;
+    engineTickMicros = tickMicros;
+    engineUseHardware = useHardware && backend->setupHardware != NULL && backend->writeHardware != NULL;
+    channelCount = 0;
+    __atomic_store_n(&engineRunning, 1, __ATOMIC_RELEASE);
+
+    // ask for real-time priority, fall back to a normal thread if that is not allowed
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+    pthread_attr_setschedparam(&attr, &param);
+
+    if (pthread_create(&engineThread, &attr, runEngine, NULL) != 0 && pthread_create(&engineThread, NULL, runEngine, NULL) != 0)
+    {
+        __atomic_store_n(&engineRunning, 0, __ATOMIC_RELAXED);
+        pthread_attr_destroy(&attr);
+        return -1;
+    }
+    pthread_attr_destroy(&attr);
+    return 0;
+}
+
+/*
+Adds a pin to the running engine, starting at value 0. Returns 0 on success, -1 if there is no free channel.
+*/
+int pwmEngineAddChannel(int pin)
+{
+    if (channelCount == PWM_MAX_CHANNELS)
+    {
+        return -1;
+    }
+
+    struct pwmChannel *channel = &channels[channelCount];
+    memset(channel, 0, sizeof(*channel));
+    channel->pin = pin;
+    channel->level = -1;
+    channel->hardware = engineUseHardware && isHardwarePwmPin(pin);
+
+    if (channel->hardware)
+    {
+        engineBackend->setupHardware(pin, engineRange, engineTickMicros);
+        engineBackend->writeHardware(pin, 0);
+    }
+
+    // publish the channel only after it is filled in
+    __atomic_store_n(&channelCount, channelCount + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/*
+Sets the value (0 to range) of a pin. Software channels pick it up at the start of the next period.
+*/
+void pwmEngineWrite(int pin, int value)
+{
+    value = value < 0 ? 0 : value > engineRange ? engineRange : value;
+
+    for (int i = 0; i < channelCount; i++)
+    {
+        if (channels[i].pin == pin)
+        {
+            __atomic_store_n(&channels[i].value, value, __ATOMIC_RELAXED);
+            if (channels[i].hardware)
+            {
+                engineBackend->writeHardware(pin, value);
+            }
+            return;
+        }
+    }
+}
+
+/*
+Duty cycle in percent the engine has driven on a pin since the start or the last reset, counted in whole ticks
+*/
+double pwmEngineDutyCycle(int pin)
+{
+    for (int i = 0; i < channelCount; i++)
+    {
+        if (channels[i].pin == pin)
+        {
+            unsigned long long onTicks, totalTicks;
+            unsigned sequence;
+
+            do
+            {
+                while ((sequence = __atomic_load_n(&statsSequence, __ATOMIC_ACQUIRE)) & 1)
+                    ;
+                onTicks = __atomic_load_n(&channels[i].onTicks, __ATOMIC_ACQUIRE);
+                totalTicks = __atomic_load_n(&channels[i].totalTicks, __ATOMIC_ACQUIRE);
+            } while (__atomic_load_n(&statsSequence, __ATOMIC_RELAXED) != sequence);
+
+            return totalTicks > 0 ? 100.0 * onTicks / totalTicks : 0;
+        }
+    }
+    return 0;
+}
+
+/*
+Level of a pin (1 on, 0 off) as the engine read it back in the latest PWM period, 0 for an unknown pin.
+Unlike the commanded value this shows a LED that did not switch.
+*/
+int pwmEngineState(int pin)
+{
+    for (int i = 0; i < channelCount; i++)
+    {
+        if (channels[i].pin == pin)
+        {
+            return __atomic_load_n(&channels[i].state, __ATOMIC_RELAXED);
+        }
+    }
+    return 0;
+}
+
+/*
+Periods since the start or the last reset in which the engine thread was held up for more than LATE_TICKS,
+the duty cycle the pins really had may differ from the counted one in those
+*/
+unsigned long pwmEngineLatePeriods()
+{
+    return __atomic_load_n(&latePeriods, __ATOMIC_RELAXED);
+}
+
+/*
+Restarts the duty cycle accounting of all channels. The engine thread does the reset at the start of its next
+period, so no period is counted half; this waits until it has happened (at most one period).
+*/
+void pwmEngineResetCounters()
+{
+    unsigned request = __atomic_add_fetch(&resetRequested, 1, __ATOMIC_RELEASE);
+
+    while (__atomic_load_n(&engineRunning, __ATOMIC_RELAXED) && __atomic_load_n(&resetDone, __ATOMIC_ACQUIRE) != request)
+    {
+        sleepMillis(1);
+    }
+}
+
+/*
+Stops the engine thread and switches every channel off
+*/
+void pwmEngineStop()
+{
+    if (!__atomic_load_n(&engineRunning, __ATOMIC_RELAXED))
+    {
+        return;
+    }
+    __atomic_store_n(&engineRunning, 0, __ATOMIC_RELAXED);
+    pthread_join(engineThread, NULL);
+    resetDone = resetRequested; // a reset nobody handled any more
+
+    for (int i = 0; i < channelCount; i++)
+    {
+        if (channels[i].hardware)
+        {
+            engineBackend->writeHardware(channels[i].pin, 0);
+        }
+        else
+        {
+            engineBackend->write(channels[i].pin, 0);
+        }
+    }
+    channelCount = 0;
+}
+
+/* SIMULATED GPIO BACKEND */
+
+// the engine thread writes the pins while other threads read the duty cycle
+static pthread_mutex_t simulatedLock = PTHREAD_MUTEX_INITIALIZER;
+static int simulatedLevel[SIMULATED_PINS];
+static struct timespec simulatedStart[SIMULATED_PINS]; // first write to the pin
+static struct timespec simulatedRise[SIMULATED_PINS];  // latest switch to high
+static double simulatedHigh[SIMULATED_PINS];           // seconds the pin was high before the latest rise
+static int simulatedUsed[SIMULATED_PINS];
+
+static double secondsBetween(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void simulatedWrite(int pin, int value)
+{
+    struct timespec now;
+
+    if (pin < 0 || pin >= SIMULATED_PINS)
+    {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    pthread_mutex_lock(&simulatedLock);
+
+    if (!simulatedUsed[pin])
+    {
+        simulatedUsed[pin] = 1;
+        simulatedStart[pin] = now;
+    }
+    if (value && !simulatedLevel[pin])
+    {
+        simulatedRise[pin] = now;
+    }
+    else if (!value && simulatedLevel[pin])
+    {
+        simulatedHigh[pin] += secondsBetween(&simulatedRise[pin], &now);
+    }
+    simulatedLevel[pin] = value != 0;
+    pthread_mutex_unlock(&simulatedLock);
+}
+
+static int simulatedRead(int pin)
+{
+    if (pin < 0 || pin >= SIMULATED_PINS)
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&simulatedLock);
+    int level = simulatedLevel[pin];
+    pthread_mutex_unlock(&simulatedLock);
+    return level;
+}
+
+/*
+Duty cycle in percent a simulated pin was actually high since its first write
+*/
+double simulatedDutyCycle(int pin)
+{
+    struct timespec now;
+
+    if (pin < 0 || pin >= SIMULATED_PINS)
+    {
+        return 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    pthread_mutex_lock(&simulatedLock);
+
+    double high = simulatedHigh[pin] + (simulatedLevel[pin] ? secondsBetween(&simulatedRise[pin], &now) : 0);
+    double total = simulatedUsed[pin] ? secondsBetween(&simulatedStart[pin], &now) : 0;
+    pthread_mutex_unlock(&simulatedLock);
+    return total > 0 ? 100.0 * high / total : 0;
+}
+
+/*
+Restarts the duty cycle measurement of every pin from now. The pin levels are kept: the engine only writes
+a pin when its level changes, so a pin that stays high after the reset still counts as high.
+The engine calls this from its thread through resetCounters, at the same period start as its own reset.
+*/
+void resetSimulatedPins()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    pthread_mutex_lock(&simulatedLock);
+    for (int pin = 0; pin < SIMULATED_PINS; pin++)
+    {
+        simulatedStart[pin] = now;
+        simulatedRise[pin] = now;
+        simulatedHigh[pin] = 0;
+    }
+    pthread_mutex_unlock(&simulatedLock);
+}
+
+// the simulated backend has no hardware PWM, every channel runs in software
+const struct pwmBackend simulatedPwmBackend = {simulatedWrite, simulatedRead, NULL, NULL, resetSimulatedPins};
@@ -0,0 +1,44 @@
+/*
+pwmEngine.h
+
+Single-threaded multiplexed PWM engine.
+wiringPi's softPwm starts one busy high-priority thread per pin. This engine drives every channel from one
+thread: at the start of each PWM period all active channels are switched on, their switch-off edges are
+sorted, and the thread sleeps until each edge in turn. Right after switching them on it reads every pin back,
+so pwmEngineState reports what a pin did rather than what it was told. Pins that have a hardware PWM channel can be handed
+to the hardware instead. GPIO access goes through a backend so the engine also runs on the simulated backend,
+pwmCheck.c compares the duty cycle the engine counts with the one the simulated pins actually had.
+*/
+
+#ifndef PWM_ENGINE_H
+#define PWM_ENGINE_H
+
+#define PWM_MAX_CHANNELS 8     // number of pins one engine can drive
+#define PWM_ENGINE_THREAD "pwm" // telemetry label of the engine thread
+
+/* How the engine reaches the GPIO pins */
+struct pwmBackend
+{
+    void (*write)(int pin, int value);                         // set a pin high (1) or low (0)
+    int (*read)(int pin);                                      // optional, level of a pin (1 high, 0 low)
+    void (*setupHardware)(int pin, int range, int tickMicros); // switch a pin to its hardware PWM channel
+    void (*writeHardware)(int pin, int value);                 // set the hardware PWM value (0 to range)
+    void (*resetCounters)(void);                               // optional, called by the engine thread when its counters restart
+};
+
+// simulated GPIO backend, keeps the pin levels in memory and measures how long each pin was high
+extern const struct pwmBackend simulatedPwmBackend;
+double simulatedDutyCycle(int pin);
+void resetSimulatedPins();
+
+int pwmEngineStart(const struct pwmBackend *backend, int range, int tickMicros, int useHardware);
+int pwmEngineAddChannel(int pin);
+void pwmEngineWrite(int pin, int value);
+double pwmEngineDutyCycle(int pin);
+int pwmEngineState(int pin);
+unsigned long pwmEngineLatePeriods();
+void pwmEngineResetCounters();
+void pwmEngineStop();
+int isHardwarePwmPin(int pin);
+
+#endif
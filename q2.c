@@ -3,16 +3,28 @@
 /* This program sorts a list of n elements in ascending  order*/
 /* 1. make a loop & compare the iterated element w. next array element & swap to match criteria */
 /* 2. loop the above till all elements have been iterated through */
+/* ./bubblesort --bench compares bubble sort, qsort() and the  */
+/* adaptive sort of adaptiveSort.c on different input shapes   */
 /*************************************************************/
 #include <stdio.h>  //'stdio.h' allow for standard input/output functions
 #include <stdlib.h> //'stdlib.h' include functions like xand() for random number generation
 #include <time.h> //'time.h' provides time-related functions and types for measuring execution time.
 #include <math.h> //'math.h' provides functions like pow() 
+#include <string.h> //'string.h' provides memcpy() and strcmp()
+#include "adaptiveSort.h" //adaptive run-detecting merge sort used by the benchmark
 #define MAX_SIZE 202 //A preprocessor directive that defines a symbolic name 'MAX_SIZE'. This defined value will be used as the maximum size of the array to be sorted.
+#define BENCH_SHAPES 5 //number of input shapes in the benchmark: random, sorted, nearly sorted, reversed, merged runs
+#define BUBBLE_LIMIT 20000 //bubble sort is O(n^2) on every shape, larger sizes are skipped in the benchmark
 void bubblesort(int x[], int n); // This is a function prototype declaration. It tells the compiler that there's a function names 'bubblesort' defined somewhere in the code
+int benchmark(void); //benchmark sweep over sizes and input shapes, run with --bench
 
-int main() //This is the entry point of the program.
+int main(int argc, char *argv[]) //This is the entry point of the program.
 {
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+    {
+        return benchmark();     //run the sort benchmark instead of the bubble sort demo
+    }
+
     int x[MAX_SIZE];            /*Integer array that will store the number to be sorted*/
     int num_items;              /*an integer that will store the number of items in the list*/
     int i;                      /*loop counter        */
@@ -72,3 +84,145 @@ void bubblesort(int x[], int n)     //This is the definition of the 'bubblesort'
     }
 } 
 
+
+/********************************************************/
+/*  function : compare ints                             */
+/*  comparison function for the C library qsort()       */
+/*  Return:                                             */
+/*    <0, 0 or >0 when a is less, equal or greater      */
+/********************************************************/
+static int compareInts(const void *a, const void *b)
+{
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return (x > y) - (x < y);   //avoids the overflow of returning x - y
+}
+
+/********************************************************/
+/*  function : fill shape                               */
+/*  fills x[] with n values in one of the input shapes  */
+/*  Input :                                             */
+/*    shape - 0 random, 1 sorted, 2 nearly sorted       */
+/*            (1% of the elements swapped), 3 reversed, */
+/*            4 merged runs (16 sorted runs one after   */
+/*            the other, like concatenated sensor logs) */
+/********************************************************/
+static void fillShape(int x[], int n, int shape)
+{
+    int i;
+    int runLength = n / 16 + 1;
+
+    for (i = 0; i < n; ++i)
+    {
+        switch (shape)
+        {
+        case 0:
+            x[i] = rand();
+            break;
+        case 3:
+            x[i] = n - i;
+            break;
+        case 4:
+            x[i] = (i % runLength) * 10 + rand() % 10;   //each run ascends, the runs overlap in value
+            if (i % runLength > 0 && x[i] < x[i - 1])
+                x[i] = x[i - 1];
+            break;
+        default:
+            x[i] = i;
+            break;
+        }
+    }
+    if (shape == 2)
+    {
+        for (i = 0; i < n / 100; ++i)   //swap 1% of the elements with a random partner
+        {
+            int a = rand() % n;
+            int b = rand() % n;
+            int temp = x[a];
+            x[a] = x[b];
+            x[b] = temp;
+        }
+    }
+}
+
+/********************************************************/
+/*  function : benchmark                                */
+/*  times bubble sort, qsort() and the adaptive sort    */
+/*  over several sizes and input shapes and checks that */
+/*  all of them produce the same sorted array           */
+/*  Return:                                             */
+/*    0 on success, 1 on error                          */
+/********************************************************/
+int benchmark(void)
+{
+    const char *shapeNames[BENCH_SHAPES] = {"random", "sorted", "nearly sorted", "reversed", "merged runs"};
+    int sizes[] = {MAX_SIZE, 2000, 20000, 200000, 2000000};
+    int sizeCount = sizeof(sizes) / sizeof(sizes[0]);
+    int maxSize = sizes[sizeCount - 1];
+    struct adaptiveSorter sorter = {0};   /*merge buffer is allocated once here and reused by every sort*/
+    int *input = malloc(maxSize * sizeof(int));
+    int *expected = malloc(maxSize * sizeof(int));
+    int *x = malloc(maxSize * sizeof(int));
+    int shape, s;
+    int result = 1;
+
+    if (input == NULL || expected == NULL || x == NULL || initAdaptiveSorter(&sorter, maxSize) != 0)
+    {
+        fprintf(stderr, "Memory allocation failed");
+        goto cleanup;
+    }
+
+    printf("%-14s %8s %14s %14s %14s\n", "Shape", "Size", "bubblesort ms", "qsort ms", "adaptive ms");
+    for (shape = 0; shape < BENCH_SHAPES; ++shape)
+    {
+        for (s = 0; s < sizeCount; ++s)
+        {
+            int n = sizes[s];
+            char bubbleTime[32] = "-";
+            clock_t begin;
+
+            srand(n + shape);   //same input for every sort of this size and shape
+            fillShape(input, n, shape);
+
+            if (n <= BUBBLE_LIMIT)
+            {
+                memcpy(x, input, n * sizeof(int));
+                begin = clock();
+                bubblesort(x, n);
+                snprintf(bubbleTime, sizeof(bubbleTime), "%.3f", (double)(clock() - begin) * 1000 / CLOCKS_PER_SEC);
+            }
+
+            memcpy(expected, input, n * sizeof(int));
+            begin = clock();
+            qsort(expected, n, sizeof(int), compareInts);
+            double qsortTime = (double)(clock() - begin) * 1000 / CLOCKS_PER_SEC;
+
+            if (n <= BUBBLE_LIMIT && memcmp(x, expected, n * sizeof(int)) != 0)
+            {
+                printf("bubblesort result differs for %s %d\n", shapeNames[shape], n);
+                goto cleanup;
+            }
+
+            memcpy(x, input, n * sizeof(int));
+            begin = clock();
+            adaptiveSort(&sorter, x, n);
+            double adaptiveTime = (double)(clock() - begin) * 1000 / CLOCKS_PER_SEC;
+
+            if (memcmp(x, expected, n * sizeof(int)) != 0)
+            {
+                printf("adaptive sort result differs for %s %d\n", shapeNames[shape], n);
+                goto cleanup;
+            }
+
+            printf("%-14s %8d %14s %14.3f %14.3f\n", shapeNames[shape], n, bubbleTime, qsortTime, adaptiveTime);
+        }
+    }
+    result = 0;
+
+cleanup:   //every path frees everything, free(NULL) does nothing
+    freeAdaptiveSorter(&sorter);
+    free(input);
+    free(expected);
+    free(x);
+    return result;
+}
@@ -0,0 +1,340 @@
+/*
+telemetry.c
+
+Counters, lateness histogram and Prometheus text output for the recorder and the PWM engine, see telemetry.h.
+*/
+
+// header files
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "telemetry.h"
+
+// DEFINITIONS
+#define CALIBRATION_READS 1000 // clock reads used to measure the cost of one read
+
+/* One metric of the stats file, written with one line per published thread */
+struct metric
+{
+    const char *name;
+    const char *type;
+    const char *help;
+    int count; // 1 if the value is a whole number
+};
+
+enum
+{
+    UPTIME,
+    LOOP_ITERATIONS,
+    LOOP_RATE,
+    SAMPLES_TAKEN,
+    SAMPLES_EXPECTED,
+    LATENESS_MAX,
+    LATENESS_P99,
+    LATE_PERIODS,
+    GPIO_CALLS,
+    GPIO_SECONDS,
+    BUFFER_HIGH_WATER,
+    BUFFER_CAPACITY,
+    OVERHEAD_SECONDS,
+    OVERHEAD_RATIO,
+    METRICS
+};
+
+static const struct metric metrics[METRICS] = {
+    [UPTIME] = {"led_recorder_uptime_seconds", "gauge", "Seconds since the thread started counting.", 0},
+    [LOOP_ITERATIONS] = {"led_recorder_loop_iterations_total", "counter", "Passes of the thread's loop (PWM periods for the pwm thread).", 1},
+    [LOOP_RATE] = {"led_recorder_loop_iterations_per_second", "gauge", "Loop rate over the last interval.", 0},
+    [SAMPLES_TAKEN] = {"led_recorder_samples_taken_total", "counter", "Samples stored (PWM periods started for the pwm thread).", 1},
+    [SAMPLES_EXPECTED] = {"led_recorder_samples_expected_total", "counter", "Samples that should have been taken at the sample period.", 1},
+    [LATENESS_MAX] = {"led_recorder_sample_lateness_max_microseconds", "gauge", "Largest delay of a sample past its period.", 1},
+    [LATENESS_P99] = {"led_recorder_sample_lateness_p99_microseconds", "gauge", "99th percentile of the sample delay (interpolated in 100us buckets).", 1},
+    [LATE_PERIODS] = {"led_recorder_late_periods_total", "counter", "Periods the thread was held up in: skipped periods, for the pwm thread also periods with an edge written late.", 1},
+    [GPIO_CALLS] = {"led_recorder_gpio_calls_total", "counter", "GPIO calls that were timed (every call of one loop pass in TELEMETRY_GPIO_SAMPLING).", 1},
+    [GPIO_SECONDS] = {"led_recorder_gpio_seconds_total", "counter", "Time spent in the timed GPIO calls.", 0},
+    [BUFFER_HIGH_WATER] = {"led_recorder_buffer_high_water", "gauge", "Most sample buffer slots in use.", 1},
+    [BUFFER_CAPACITY] = {"led_recorder_buffer_capacity", "gauge", "Sample buffer slots.", 1},
+    [OVERHEAD_SECONDS] = {"led_recorder_telemetry_overhead_seconds_total", "counter", "Time spent on telemetry.", 0},
+    [OVERHEAD_RATIO] = {"led_recorder_telemetry_overhead_ratio", "gauge", "Telemetry time as a fraction of the run time.", 0},
+};
+
+// latest copy of every publishing thread's counters, the stats file is written from these
+static pthread_mutex_t publishLock = PTHREAD_MUTEX_INITIALIZER;
+static struct telemetry published[TELEMETRY_THREADS];
+static int publishedCount = 0;
+
+/*
+Monotonic time in microseconds
+*/
+uint64_t telemetryNow()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/*
+Resets the counters of a thread and measures how much one clock read costs,
+which is used to report the overhead of the telemetry itself
+*/
+void telemetryStart(struct telemetry *stats, const char *thread, uint32_t samplePeriodMicros, uint32_t bufferCapacity)
+{
+    struct timespec start, end, scratch;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->thread = thread;
+    stats->samplePeriodMicros = samplePeriodMicros;
+    stats->bufferCapacity = bufferCapacity;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < CALIBRATION_READS; i++)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &scratch);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    stats->clockReadMicros = ((end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3) / CALIBRATION_READS;
+
+    stats->startMicros = telemetryNow();
+    stats->lastSampleMicros = stats->startMicros;
+    stats->lastPublishMicros = stats->startMicros;
+}
+
+/*
+Adds the time since startMicros (from telemetryGpioStart before the call) to the GPIO time, once per GPIO call.
+Reading the clock twice costs about as much as a GPIO write, so only the calls of one in TELEMETRY_GPIO_SAMPLING
+loop passes are timed.
+*/
+void telemetryGpio(struct telemetry *stats, uint64_t startMicros)
+{
+    if (startMicros == 0)
+    {
+        return;
+    }
+    stats->gpioMicros += telemetryNow() - startMicros;
+    stats->gpioCalls++;
+    stats->clockReads += 2;
+}
+
+/*
+Records one sample: its lateness against the sample period and the number of buffer slots in use.
+A sample that is one or more whole periods late counts those periods as late.
+*/
+void telemetrySample(struct telemetry *stats, uint32_t bufferUsed)
+{
+    uint64_t now = telemetryNow();
+    uint64_t interval = now - stats->lastSampleMicros;
+    uint64_t lateness = stats->samplesTaken > 0 && interval > stats->samplePeriodMicros ? interval - stats->samplePeriodMicros : 0;
+    uint64_t bucket = lateness / TELEMETRY_BUCKET_MICROS;
+
+    stats->latenessHistogram[bucket < TELEMETRY_BUCKETS - 1 ? bucket : TELEMETRY_BUCKETS - 1]++;
+    if (stats->samplePeriodMicros > 0)
+    {
+        stats->latePeriods += lateness / stats->samplePeriodMicros;
+    }
+    if (lateness > stats->latenessMax)
+    {
+        stats->latenessMax = lateness;
+    }
+    if (bufferUsed > stats->bufferHighWater)
+    {
+        stats->bufferHighWater = bufferUsed;
+    }
+
+    stats->lastSampleMicros = now;
+    stats->samplesTaken++;
+    stats->clockReads++;
+}
+
+/*
+Lateness percentile (0 to 100) in microseconds, interpolated linearly inside the histogram bucket it falls in.
+The last bucket reaches up to the largest lateness seen, and the result never exceeds it.
+*/
+uint64_t telemetryPercentile(const struct telemetry *stats, double percentile)
+{
+    double target = stats->samplesTaken * percentile / 100.0;
+    uint64_t seen = 0;
+
+    for (int bucket = 0; bucket < TELEMETRY_BUCKETS; bucket++)
+    {
+        uint64_t count = stats->latenessHistogram[bucket];
+
+        if (count > 0 && seen + count >= target)
+        {
+            double lower = (double)bucket * TELEMETRY_BUCKET_MICROS;
+            double upper = bucket < TELEMETRY_BUCKETS - 1 ? lower + TELEMETRY_BUCKET_MICROS : stats->latenessMax;
+            uint64_t value = (uint64_t)(lower + (upper - lower) * (target - seen) / count + 0.5);
+            return value < stats->latenessMax ? value : stats->latenessMax;
+        }
+        seen += count;
+    }
+    return stats->latenessMax;
+}
+
+static double elapsedSeconds(const struct telemetry *stats)
+{
+    return (stats->lastPublishMicros - stats->startMicros) / 1e6;
+}
+
+static uint64_t expectedSamples(const struct telemetry *stats)
+{
+    return stats->samplePeriodMicros ? (stats->lastPublishMicros - stats->startMicros) / stats->samplePeriodMicros + 1 : 0;
+}
+
+/*
+Clock reads at their measured cost plus the previous file writes, in seconds
+*/
+static double overheadSeconds(const struct telemetry *stats)
+{
+    return (stats->clockReads * stats->clockReadMicros + stats->publishMicros) / 1e6;
+}
+
+static double metricValue(const struct telemetry *stats, int metric)
+{
+    double elapsed = elapsedSeconds(stats);
+
+    switch (metric)
+    {
+    case UPTIME:
+        return elapsed;
+    case LOOP_ITERATIONS:
+        return stats->loopIterations;
+    case LOOP_RATE:
+        return stats->loopRate;
+    case SAMPLES_TAKEN:
+        return stats->samplesTaken;
+    case SAMPLES_EXPECTED:
+        return expectedSamples(stats);
+    case LATENESS_MAX:
+        return stats->latenessMax;
+    case LATENESS_P99:
+        return telemetryPercentile(stats, 99);
+    case LATE_PERIODS:
+        return stats->latePeriods;
+    case GPIO_CALLS:
+        return stats->gpioCalls;
+    case GPIO_SECONDS:
+        return stats->gpioMicros / 1e6;
+    case BUFFER_HIGH_WATER:
+        return stats->bufferHighWater;
+    case BUFFER_CAPACITY:
+        return stats->bufferCapacity;
+    case OVERHEAD_SECONDS:
+        return overheadSeconds(stats);
+    default:
+        return elapsed > 0 ? overheadSeconds(stats) / elapsed : 0;
+    }
+}
+
+/*
+Writes TELEMETRY_FILE from the published copies, every metric once with a line per thread. Called with publishLock held.
+*/
+static void writeStatsFile()
+{
+    char tempName[sizeof(TELEMETRY_FILE) + 4];
+
+    snprintf(tempName, sizeof(tempName), "%s.tmp", TELEMETRY_FILE);
+    FILE *file = fopen(tempName, "w");
+    if (file == NULL)
+    {
+        return;
+    }
+
+    for (int m = 0; m < METRICS; m++)
+    {
+        fprintf(file, "# HELP %s %s\n# TYPE %s %s\n", metrics[m].name, metrics[m].help, metrics[m].name, metrics[m].type);
+        for (int t = 0; t < publishedCount; t++)
+        {
+            double value = metricValue(&published[t], m);
+
+            if (metrics[m].count)
+                fprintf(file, "%s{thread=\"%s\"} %llu\n", metrics[m].name, published[t].thread, (unsigned long long)value);
+            else
+                fprintf(file, "%s{thread=\"%s\"} %.6f\n", metrics[m].name, published[t].thread, value);
+        }
+    }
+
+    fclose(file);
+    rename(tempName, TELEMETRY_FILE);
+}
+
+/*
+Publishes the counters if a publish interval has passed (or always when force is set): the copy of this thread
+in the shared table is replaced and TELEMETRY_FILE is rewritten with every thread's lines
+*/
+void telemetryPublish(struct telemetry *stats, int force)
+{
+    uint64_t now = telemetryNow();
+
+    stats->clockReads++;
+    if (!force && now - stats->lastPublishMicros < TELEMETRY_PUBLISH_MICROS)
+    {
+        return;
+    }
+
+    double interval = (now - stats->lastPublishMicros) / 1e6;
+
+    stats->loopRate = interval > 0 ? (stats->loopIterations - stats->lastPublishIterations) / interval : 0;
+    stats->lastPublishIterations = stats->loopIterations;
+    stats->lastPublishMicros = now;
+
+    pthread_mutex_lock(&publishLock);
+    int slot = 0;
+    while (slot < publishedCount && strcmp(published[slot].thread, stats->thread) != 0)
+    {
+        slot++;
+    }
+    if (slot < TELEMETRY_THREADS)
+    {
+        publishedCount += slot == publishedCount;
+        published[slot] = *stats;
+        writeStatsFile();
+    }
+    pthread_mutex_unlock(&publishLock);
+
+    stats->publishMicros += telemetryNow() - now;
+}
+
+/*
+Copies the counters a thread published last, so other threads can print them.
+Returns 0, or -1 if that thread has not published yet.
+*/
+int telemetryPublished(const char *thread, struct telemetry *copy)
+{
+    int found = -1;
+
+    pthread_mutex_lock(&publishLock);
+    for (int t = 0; t < publishedCount && found != 0; t++)
+    {
+        if (strcmp(published[t].thread, thread) == 0)
+        {
+            *copy = published[t];
+            found = 0;
+        }
+    }
+    pthread_mutex_unlock(&publishLock);
+    return found;
+}
+
+/*
+Prints a short summary of the counters, e.g. at the end of a recording
+*/
+void printTelemetry(FILE *out, const struct telemetry *stats)
+{
+    double elapsed = elapsedSeconds(stats);
+    double overhead = overheadSeconds(stats);
+
+    fprintf(out, "Telemetry (%s): %.0f loops/s, %llu of %llu samples, lateness p99 %llu us max %llu us\n",
+            stats->thread, elapsed > 0 ? stats->loopIterations / elapsed : 0, (unsigned long long)stats->samplesTaken,
+            (unsigned long long)expectedSamples(stats), (unsigned long long)telemetryPercentile(stats, 99), (unsigned long long)stats->latenessMax);
+    fprintf(out, "Telemetry (%s): %llu late periods", stats->thread, (unsigned long long)stats->latePeriods);
+    if (stats->gpioCalls > 0)
+    {
+        fprintf(out, ", GPIO %.2f us per call", (double)stats->gpioMicros / stats->gpioCalls);
+    }
+    if (stats->bufferCapacity > 0)
+    {
+        fprintf(out, ", buffer %u of %u", stats->bufferHighWater, stats->bufferCapacity);
+    }
+    fprintf(out, ", overhead %.3f s (%.2f%%)\n", overhead, elapsed > 0 ? 100 * overhead / elapsed : 0);
+}
@@ -0,0 +1,78 @@
+/*
+telemetry.h
+
+Low-overhead runtime counters for the LED recorder loop and the PWM engine thread.
+Each thread keeps its own struct telemetry and is the only one that writes it, so counting needs no locking.
+Once per second the owning thread publishes a copy into a table shared by all threads and rewrites a stats file
+in the Prometheus text format with the lines of every thread (written to a temporary file and renamed,
+so readers never see half a file). Only the copy and the file write take a lock.
+*/
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define TELEMETRY_FILE "/tmp/ledRecorder.prom" // e.g. for node_exporter's textfile collector
+#define TELEMETRY_THREADS 4                    // threads that can publish into TELEMETRY_FILE
+#define TELEMETRY_BUCKET_MICROS 100            // width of one lateness histogram bucket
+#define TELEMETRY_BUCKETS 101                  // 100 linear buckets up to 10ms (one sample period) plus one for anything later
+#define TELEMETRY_PUBLISH_MICROS 1000000       // rewrite the stats file once per second
+#define TELEMETRY_GPIO_SAMPLING 8              // time the GPIO calls of one in 8 loop passes
+
+struct telemetry
+{
+    const char *thread; // label of the owning thread
+
+    uint64_t startMicros;
+    uint64_t lastSampleMicros;
+    uint64_t lastPublishMicros;
+    uint64_t lastPublishIterations;
+    uint32_t samplePeriodMicros;
+
+    uint64_t loopIterations;
+    double loopRate; // iterations per second over the last publish interval
+    uint64_t samplesTaken;
+    uint64_t latenessMax; // microseconds
+    uint64_t latenessHistogram[TELEMETRY_BUCKETS];
+    uint64_t latePeriods; // whole sample periods skipped, plus the periods the owner reported with telemetryLate
+    uint64_t gpioCalls;   // timed GPIO calls
+    uint64_t gpioMicros;  // time spent in them
+    uint32_t bufferHighWater;
+    uint32_t bufferCapacity;
+
+    // cost of the telemetry itself
+    uint64_t clockReads;
+    double clockReadMicros; // measured cost of one clock read
+    uint64_t publishMicros; // time spent writing the stats file
+};
+
+uint64_t telemetryNow();
+void telemetryStart(struct telemetry *stats, const char *thread, uint32_t samplePeriodMicros, uint32_t bufferCapacity);
+void telemetryGpio(struct telemetry *stats, uint64_t startMicros);
+void telemetrySample(struct telemetry *stats, uint32_t bufferUsed);
+void telemetryPublish(struct telemetry *stats, int force);
+int telemetryPublished(const char *thread, struct telemetry *copy);
+uint64_t telemetryPercentile(const struct telemetry *stats, double percentile);
+void printTelemetry(FILE *out, const struct telemetry *stats);
+
+/* Counts one pass of the record loop */
+static inline void telemetryLoop(struct telemetry *stats)
+{
+    stats->loopIterations++;
+}
+
+/* Counts periods the owner was held up in that telemetrySample does not see as skipped */
+static inline void telemetryLate(struct telemetry *stats, uint64_t periods)
+{
+    stats->latePeriods += periods;
+}
+
+/* Start time for timing one GPIO call, 0 if the calls of this loop pass are not timed */
+static inline uint64_t telemetryGpioStart(const struct telemetry *stats)
+{
+    return stats->loopIterations % TELEMETRY_GPIO_SAMPLING == 0 ? telemetryNow() : 0;
+}
+
+#endif
@@ -0,0 +1,205 @@
+/*
+waveAnalyser.c
+
+Edge detection and statistics for LED waveform captures, see waveAnalyser.h.
+All times are in milliseconds, the unit of the time iteration column in displayPlot.csv.
+*/
+
+// header files
+#include <math.h>
+#include <string.h>
+#include "waveAnalyser.h"
+
+/*
+Resets the statistics of a channel and stores the configured frequency and duty cycle,
+which are used to spot missed toggles and glitches. A frequency of 0 disables those checks.
+*/
+void initWaveStats(struct waveStats *stats, int frequency, float dutyCycle)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->lastState = -1;
+    stats->lastRise = -1;
+    stats->lastFall = -1;
+    stats->periodMin = HUGE_VAL;
+
+    if (frequency > 0)
+    {
+        stats->expectedPeriod = 1000.0 / frequency;
+        stats->expectedHigh = stats->expectedPeriod * dutyCycle / 100.0;
+    }
+}
+
+/*
+Feeds one sample into the analyser.
+Returns 1 if the sample is a rising edge, 0 otherwise.
+*/
+int updateWaveStats(struct waveStats *stats, double time, int state)
+{
+    state = state != 0;
+
+    if (stats->samples++ == 0)
+    {
+        stats->firstTime = time;
+        stats->lastTime = time;
+        stats->lastState = state;
+        stats->pulseStart = time;
+        return 0;
+    }
+    stats->lastTime = time;
+
+    if (state == stats->lastState)
+    {
+        return 0;
+    }
+
+    /* the pulse of level lastState has just ended, the first pulse is cut off by the start of the capture */
+    if (stats->expectedPeriod > 0 && stats->pulseStart != stats->firstTime)
+    {
+        double width = time - stats->pulseStart;
+        double expectedWidth = stats->lastState ? stats->expectedHigh : stats->expectedPeriod - stats->expectedHigh;
+
+        if (expectedWidth > 0 && width < expectedWidth / 2)
+        {
+            stats->glitches++;
+        }
+    }
+    stats->pulseStart = time;
+    stats->lastState = state;
+
+    if (!state)
+    {
+        stats->fallingEdges++;
+        stats->lastFall = time;
+        return 0;
+    }
+
+    stats->risingEdges++;
+    if (stats->lastRise >= 0)
+    {
+        double period = time - stats->lastRise;
+        double delta = period - stats->periodMean;
+
+        stats->periods++;
+        stats->periodMean += delta / stats->periods;
+        stats->periodM2 += delta * (period - stats->periodMean);
+        if (period < stats->periodMin)
+        {
+            stats->periodMin = period;
+        }
+        if (period > stats->periodMax)
+        {
+            stats->periodMax = period;
+        }
+
+        /* a complete period has a falling edge between its two rising edges */
+        if (stats->lastFall > stats->lastRise)
+        {
+            stats->highTime += stats->lastFall - stats->lastRise;
+            stats->cycleTime += period;
+        }
+
+        if (stats->expectedPeriod > 0 && period > 1.5 * stats->expectedPeriod)
+        {
+            stats->missedToggles += (long)(period / stats->expectedPeriod + 0.5) - 1;
+        }
+    }
+    stats->lastRise = time;
+    return 1;
+}
+
+/*
+Frequency in Hz from the mean rising-to-rising period, 0 if fewer than two rising edges were seen
+*/
+double measuredFrequency(const struct waveStats *stats)
+{
+    return stats->periods > 0 ? 1000.0 / stats->periodMean : 0;
+}
+
+/*
+Duty cycle in percent over the complete periods; an LED that never toggled is either 0% or 100%
+*/
+double measuredDutyCycle(const struct waveStats *stats)
+{
+    if (stats->cycleTime > 0)
+    {
+        return 100.0 * stats->highTime / stats->cycleTime;
+    }
+    return stats->lastState == 1 ? 100.0 : 0.0;
+}
+
+/*
+Standard deviation of the period in milliseconds
+*/
+double periodJitter(const struct waveStats *stats)
+{
+    return stats->periods > 1 ? sqrt(stats->periodM2 / (stats->periods - 1)) : 0;
+}
+
+void printWaveStats(FILE *out, const char *name, const struct waveStats *stats)
+{
+    double configuredFrequency = stats->expectedPeriod > 0 ? 1000.0 / stats->expectedPeriod : 0;
+    double configuredDutyCycle = stats->expectedPeriod > 0 ? 100.0 * stats->expectedHigh / stats->expectedPeriod : 0;
+
+    fprintf(out, "%s LED: %ld samples, %ld rising / %ld falling edges\n", name, stats->samples, stats->risingEdges, stats->fallingEdges);
+    fprintf(out, "  frequency   configured %.2f Hz, measured %.2f Hz\n", configuredFrequency, measuredFrequency(stats));
+    fprintf(out, "  duty cycle  configured %.1f%%, measured %.1f%%\n", configuredDutyCycle, measuredDutyCycle(stats));
+    if (stats->periods > 0)
+    {
+        fprintf(out, "  period      mean %.1f ms, jitter %.2f ms (min %.1f, max %.1f)\n",
+                stats->periodMean, periodJitter(stats), stats->periodMin, stats->periodMax);
+    }
+    fprintf(out, "  anomalies   %ld missed toggles, %ld glitches\n", stats->missedToggles, stats->glitches);
+}
+
+void initPairStats(struct pairStats *stats, int greenFrequency, float greenDutyCycle, int redFrequency, float redDutyCycle)
+{
+    initWaveStats(&stats->green, greenFrequency, greenDutyCycle);
+    initWaveStats(&stats->red, redFrequency, redDutyCycle);
+    stats->phaseCount = 0;
+    stats->phaseSin = 0;
+    stats->phaseCos = 0;
+}
+
+/*
+Feeds one row of a two channel capture. Every red rising edge is compared with the latest green rising edge
+and added to the circular mean as an angle of the green period (measured, or configured until one is measured).
+*/
+void updatePairStats(struct pairStats *stats, double time, int greenState, int redState)
+{
+    updateWaveStats(&stats->green, time, greenState);
+
+    if (updateWaveStats(&stats->red, time, redState) && stats->green.lastRise >= 0)
+    {
+        double period = stats->green.periods > 0 ? stats->green.periodMean : stats->green.expectedPeriod;
+
+        if (period > 0)
+        {
+            double angle = 2 * M_PI * (time - stats->green.lastRise) / period;
+            stats->phaseSin += sin(angle);
+            stats->phaseCos += cos(angle);
+            stats->phaseCount++;
+        }
+    }
+}
+
+/*
+Mean phase of red behind green in degrees of the green period (0 to 360).
+Only meaningful when both LEDs blink at the same frequency.
+*/
+double phaseOffsetDegrees(const struct pairStats *stats)
+{
+    if (stats->phaseCount == 0)
+    {
+        return 0;
+    }
+
+    double degrees = atan2(stats->phaseSin, stats->phaseCos) * 180.0 / M_PI;
+    return degrees < 0 ? degrees + 360.0 : degrees;
+}
+
+void printPairStats(FILE *out, const struct pairStats *stats)
+{
+    printWaveStats(out, "Green", &stats->green);
+    printWaveStats(out, "Red", &stats->red);
+    fprintf(out, "Phase offset (red behind green): %.1f degrees\n", phaseOffsetDegrees(stats));
+}
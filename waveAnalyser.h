@@ -0,0 +1,73 @@
+/*
+waveAnalyser.h
+
+Single-pass streaming analyser for LED waveform captures.
+Samples are fed one at a time (time in milliseconds, state 0/1), so the same code works on a
+live capture inside newStudent.c and on a saved displayPlot.csv. Every update is O(1) and the
+state is a fixed-size structure, so analysing n samples is O(n) with constant memory.
+*/
+
+#ifndef WAVE_ANALYSER_H
+#define WAVE_ANALYSER_H
+
+#include <stdio.h>
+
+/* Measured behaviour of one LED channel */
+struct waveStats
+{
+    // configuration the LED was asked to blink at (0 if unknown)
+    double expectedPeriod; // milliseconds
+    double expectedHigh;   // milliseconds the LED should stay on in each period
+
+    // streaming state
+    long samples;
+    int lastState;
+    double firstTime;
+    double lastTime;
+    double lastRise; // time of the latest rising edge, negative if none yet
+    double lastFall; // time of the latest falling edge, negative if none yet
+    double pulseStart;
+
+    // edges
+    long risingEdges;
+    long fallingEdges;
+
+    // rising-to-rising period statistics (Welford running mean and variance)
+    long periods;
+    double periodMean;
+    double periodM2;
+    double periodMin;
+    double periodMax;
+
+    // duty cycle over complete periods
+    double highTime;
+    double cycleTime;
+
+    // anomalies
+    long missedToggles; // whole periods that are missing between two rising edges
+    long glitches;      // pulses much shorter than the configured on or off time
+};
+
+/* Both channels of a capture plus the phase offset of red against green */
+struct pairStats
+{
+    struct waveStats green;
+    struct waveStats red;
+    long phaseCount;
+    double phaseSin; // sums of sin and cos of each red-behind-green offset as an angle of the green period,
+    double phaseCos; // averaged as a circular mean so offsets around 0 and 360 degrees do not average to 180
+};
+
+void initWaveStats(struct waveStats *stats, int frequency, float dutyCycle);
+int updateWaveStats(struct waveStats *stats, double time, int state);
+double measuredFrequency(const struct waveStats *stats);
+double measuredDutyCycle(const struct waveStats *stats);
+double periodJitter(const struct waveStats *stats);
+void printWaveStats(FILE *out, const char *name, const struct waveStats *stats);
+
+void initPairStats(struct pairStats *stats, int greenFrequency, float greenDutyCycle, int redFrequency, float redDutyCycle);
+void updatePairStats(struct pairStats *stats, double time, int greenState, int redState);
+double phaseOffsetDegrees(const struct pairStats *stats);
+void printPairStats(FILE *out, const struct pairStats *stats);
+
+#endif